@@ -0,0 +1,85 @@
+#pragma once
+
+// In-process agent: runs the collectors and refresher in the host process and
+// publishes immutable snapshots that any thread can query without triggering
+// a collection.
+//
+//   AgentOptions options;
+//   options.shm_path.clear();
+//   StartAgent(options);
+//   double score = GetNodeHealthScore();  // Latest published value.
+//   std::shared_ptr<const AgentSnapshot> snapshot = GetAgentSnapshot();
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpu_metrics.hpp"
+#include "gpu_metrics.hpp"
+#include "health_score.hpp"
+#include "metric_families.hpp"
+#include "numa_metrics.hpp"
+#include "prometheus.hpp"
+#include "shm_snapshot.hpp"
+
+// Everything published by one refresh. Immutable once published; all
+// pointers are non-null.
+struct AgentSnapshot {
+  // Increments with every publish; 0 before the agent has started.
+  uint64_t generation = 0;
+  std::chrono::system_clock::time_point published_at;
+  std::shared_ptr<const CpuMetrics> cpu;
+  std::shared_ptr<const CpuTopProcesses> processes;
+  std::shared_ptr<const std::vector<NumaNodeMetrics>> numa;
+  std::shared_ptr<const std::vector<GpuMetrics>> gpus;
+  // Scored from `cpu`; smoothing state carries over between snapshots.
+  HealthScore health;
+  AgentMetrics agent;
+  // The same snapshot rendered as Prometheus text.
+  std::shared_ptr<const MetricsSnapshot> exposition;
+  // Why the agent should not be considered ready, or nullptr when ready.
+  // Points at a string literal.
+  const char* not_ready_reason = "starting";
+};
+
+struct AgentOptions {
+  // Processes exported individually (top N by CPU time); also bounds the
+  // top-N-by-memory query.
+  size_t top_process_count = 100;
+  std::chrono::milliseconds refresh_interval{2000};
+  // Shared-memory snapshot file; empty disables the export.
+  std::string shm_path = kShmSnapshotPath;
+  // Counter-baseline checkpoint for warm restarts; empty disables it.
+  std::string state_path = "/var/lib/node-metrics-agent/state";
+  // Health score weights, smoothing half-life and capacity cgroup.
+  HealthConfig health;
+  // Called on the refresher thread after every publish; keep it cheap.
+  std::function<void(const std::shared_ptr<const AgentSnapshot>&)> on_publish;
+};
+
+// Starts collection and publishes a first snapshot before returning. Returns
+// false if the agent is already running.
+bool StartAgent(const AgentOptions& options);
+// Stops the refresher, checkpoints counter baselines and shuts NVML down.
+// The agent may be started again afterwards; snapshot generations continue.
+void StopAgent();
+
+// Latest published snapshot (an empty one before StartAgent). Thread-safe
+// and O(1): a reference-count bump, never a collection.
+std::shared_ptr<const AgentSnapshot> GetAgentSnapshot();
+
+// Convenience accessors over GetAgentSnapshot().
+double GetCpuLoad1m();
+unsigned long long GetNodeMemoryTotalBytes();
+unsigned long long GetNodeMemoryAvailableBytes();
+double GetNodeHealthScore();
+double GetNodeHealthScoreSmoothed();
+// Top processes by CPU time or by resident memory, at most `max_processes`
+// (bounded by AgentOptions::top_process_count). Both lists are ranked over
+// every process at collection time, so a query only copies a prefix.
+CpuTopProcesses GetCpuProcessCpuSecondsTotal(size_t max_processes);
+CpuTopProcesses GetCpuProcessRssBytes(size_t max_processes);
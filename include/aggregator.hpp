@@ -0,0 +1,55 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "prometheus.hpp"
+
+struct AggregatorOptions {
+  // Agent endpoints as "host:port".
+  std::vector<std::string> targets;
+  // Upper bound on concurrent agent connections.
+  size_t max_parallel = 64;
+  std::chrono::milliseconds timeout{1500};
+};
+
+struct AgentScrapeResult {
+  std::string target;
+  bool up = false;
+  double duration_seconds = 0.0;
+  std::string body;
+};
+
+// Fans in many agents over non-blocking sockets with bounded parallelism.
+// Resolved addresses are cached across scrapes and re-resolved after a
+// failure.
+class AgentScraper {
+ public:
+  explicit AgentScraper(AggregatorOptions options);
+
+  // Scrapes every target once; results are in target order.
+  std::vector<AgentScrapeResult> ScrapeAll();
+
+ private:
+  struct ResolvedAddress {
+    sockaddr_storage addr{};
+    socklen_t addr_len = 0;
+  };
+
+  bool Resolve(const std::string& target, ResolvedAddress* out);
+
+  AggregatorOptions options_;
+  std::unordered_map<std::string, ResolvedAddress> resolved_;
+};
+
+// Merges agent expositions into one snapshot: every series gains a
+// `node="<target>"` label, series are grouped by family across nodes, and
+// cluster rollups (health score quantiles, GPU memory totals, node counts)
+// are appended.
+void FormatAggregate(const std::vector<AgentScrapeResult>& results,
+                     MetricsSnapshot* snapshot);
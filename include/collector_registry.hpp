@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "collector_supervisor.hpp"
+#include "metric_batch.hpp"
+
+// A registered data source. Collection and conversion into a MetricBatch both
+// happen on the collector's own supervised worker, so collectors run in
+// parallel and the refresher only merges finished batches.
+class Collector {
+ public:
+  virtual ~Collector() = default;
+
+  virtual void RequestRefresh() = 0;
+  // Returns false if the collector overran its timeout.
+  virtual bool AwaitRefresh() = 0;
+  // False until the first collection has completed.
+  virtual bool HasSample() const = 0;
+  virtual std::shared_ptr<const MetricBatch> LastBatch() const = 0;
+  virtual CollectorStatus Status() const = 0;
+};
+
+// Collector over a typed sample `T`. The typed sample stays available for
+// consumers that need more than the exposition (shared-memory export).
+template <typename T>
+class TypedCollector : public Collector {
+ public:
+  using CollectFn = std::function<T()>;
+  using AppendFn = std::function<void(const T&, MetricBatch*)>;
+
+  TypedCollector(std::string name, CollectFn collect, AppendFn append,
+                 std::chrono::milliseconds timeout)
+      : supervised_(std::move(name),
+                    [collect = std::move(collect), append = std::move(append)] {
+                      Sample sample;
+                      auto data = std::make_shared<T>(collect());
+                      auto batch = std::make_shared<MetricBatch>();
+                      append(*data, batch.get());
+                      sample.data = std::move(data);
+                      sample.batch = std::move(batch);
+                      return sample;
+                    },
+                    timeout) {}
+
+  void RequestRefresh() override { supervised_.RequestRefresh(); }
+  bool AwaitRefresh() override { return supervised_.AwaitRefresh(); }
+  bool Refresh() { return supervised_.Refresh(); }
+  bool HasSample() const override { return supervised_.HasSample(); }
+
+  std::shared_ptr<const MetricBatch> LastBatch() const override {
+    return supervised_.LastGood().batch;
+  }
+  std::shared_ptr<const T> LastGood() const {
+    return supervised_.LastGood().data;
+  }
+  CollectorStatus Status() const override { return supervised_.Status(); }
+
+ private:
+  // Immutable once produced, so handing it out is a refcount bump.
+  struct Sample {
+    std::shared_ptr<const T> data = std::make_shared<const T>();
+    std::shared_ptr<const MetricBatch> batch =
+        std::make_shared<const MetricBatch>();
+  };
+
+  SupervisedCollector<Sample> supervised_;
+};
+
+// The single place data sources are added. Collectors are refreshed and
+// rendered in registration order.
+class CollectorRegistry {
+ public:
+  template <typename T>
+  TypedCollector<T>* Register(std::string name,
+                              typename TypedCollector<T>::CollectFn collect,
+                              typename TypedCollector<T>::AppendFn append,
+                              std::chrono::milliseconds timeout) {
+    auto collector = std::make_unique<TypedCollector<T>>(
+        std::move(name), std::move(collect), std::move(append), timeout);
+    TypedCollector<T>* handle = collector.get();
+    collectors_.push_back(std::move(collector));
+    return handle;
+  }
+
+  // Refreshes every collector concurrently; each is bounded only by its own
+  // timeout rather than by the slowest data source.
+  void RefreshAll() {
+    for (auto& collector : collectors_) {
+      collector->RequestRefresh();
+    }
+    for (auto& collector : collectors_) {
+      collector->AwaitRefresh();
+    }
+  }
+
+  // Merges every collector's last good batch into `batch`. A collector that
+  // has not completed a run yet contributes no families rather than zeros.
+  void AppendBatches(MetricBatch* batch) const {
+    for (const auto& collector : collectors_) {
+      if (!collector->HasSample()) {
+        continue;
+      }
+      batch->Append(*collector->LastBatch());
+    }
+  }
+
+  std::vector<CollectorStatus> Statuses() const {
+    std::vector<CollectorStatus> statuses;
+    for (const auto& collector : collectors_) {
+      statuses.push_back(collector->Status());
+    }
+    return statuses;
+  }
+
+ private:
+  std::vector<std::unique_ptr<Collector>> collectors_;
+};
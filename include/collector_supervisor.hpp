@@ -0,0 +1,150 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+
+struct CollectorStatus {
+  std::string name;
+  bool stale = false;
+  // Age of the last good sample while stale, 0 otherwise.
+  double stale_seconds = 0.0;
+};
+
+// Runs a collector on its own worker thread so that a hung data source
+// (D-state /proc reads, a wedged GPU driver) cannot block the refresher.
+// A refresh waits at most `timeout` for a new sample; on overrun the last
+// good sample is kept and the collector reports itself stale until a run
+// completes again. A stuck run is never duplicated: later refreshes wait on
+// the run already in flight. Until the first run completes there is no good
+// sample: LastGood() is `T{}`, HasSample() is false and staleness is measured
+// from construction.
+template <typename T>
+class SupervisedCollector {
+ public:
+  SupervisedCollector(std::string name, std::function<T()> collect,
+                      std::chrono::milliseconds timeout)
+      : state_(std::make_shared<State>()), timeout_(timeout) {
+    state_->name = std::move(name);
+    state_->last_success = std::chrono::steady_clock::now();
+    // The worker owns a reference to the shared state so it can outlive the
+    // supervisor if it is stuck inside `collect` at shutdown.
+    std::thread worker(Work, state_, std::move(collect));
+    worker.detach();
+  }
+
+  // Lets the worker exit once it is idle (or once a stuck run returns).
+  ~SupervisedCollector() {
+    {
+      std::lock_guard<std::mutex> lock(state_->mutex);
+      state_->shutdown = true;
+    }
+    state_->cv.notify_all();
+  }
+
+  SupervisedCollector(const SupervisedCollector&) = delete;
+  SupervisedCollector& operator=(const SupervisedCollector&) = delete;
+
+  // Asks the worker for a new sample without waiting for it.
+  void RequestRefresh() {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    pending_target_ = state_->completed_runs + 1;
+    pending_deadline_ = std::chrono::steady_clock::now() + timeout_;
+    if (!state_->running) {
+      state_->requested = true;
+      state_->cv.notify_all();
+    }
+  }
+
+  // Waits for the sample requested by RequestRefresh() until its deadline.
+  // Returns false (and marks the collector stale) on overrun.
+  bool AwaitRefresh() {
+    std::unique_lock<std::mutex> lock(state_->mutex);
+    const unsigned long long target = pending_target_;
+    const bool done = state_->cv.wait_until(
+        lock, pending_deadline_,
+        [this, target] { return state_->completed_runs >= target; });
+    state_->stale = !done;
+    return done;
+  }
+
+  bool Refresh() {
+    RequestRefresh();
+    return AwaitRefresh();
+  }
+
+  T LastGood() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->last_good;
+  }
+
+  // True once a run has completed.
+  bool HasSample() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    return state_->completed_runs > 0;
+  }
+
+  CollectorStatus Status() const {
+    std::lock_guard<std::mutex> lock(state_->mutex);
+    CollectorStatus status;
+    status.name = state_->name;
+    status.stale = state_->stale;
+    if (status.stale) {
+      status.stale_seconds = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() -
+                                 state_->last_success)
+                                 .count();
+    }
+    return status;
+  }
+
+ private:
+  struct State {
+    std::string name;
+    mutable std::mutex mutex;
+    std::condition_variable cv;
+    bool requested = false;
+    bool running = false;
+    bool stale = false;
+    bool shutdown = false;
+    unsigned long long completed_runs = 0;
+    T last_good{};
+    std::chrono::steady_clock::time_point last_success;
+  };
+
+  static void Work(std::shared_ptr<State> state, std::function<T()> collect) {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->cv.wait(lock, [&state] {
+          return state->requested || state->shutdown;
+        });
+        if (state->shutdown) {
+          return;
+        }
+        state->requested = false;
+        state->running = true;
+      }
+      T sample = collect();
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->last_good = std::move(sample);
+        state->last_success = std::chrono::steady_clock::now();
+        state->running = false;
+        ++state->completed_runs;
+      }
+      state->cv.notify_all();
+    }
+  }
+
+  std::shared_ptr<State> state_;
+  std::chrono::milliseconds timeout_;
+  // Only touched by the refresher thread.
+  unsigned long long pending_target_ = 0;
+  std::chrono::steady_clock::time_point pending_deadline_;
+};
@@ -9,31 +9,70 @@ struct CpuMetrics {
   double cpu_utilization = 0.0;
   double cpu_pressure_avg10 = 0.0;
   double memory_pressure_avg10 = 0.0;
+  double io_pressure_avg10 = 0.0;
   unsigned long long mem_total_bytes = 0;
   unsigned long long mem_available_bytes = 0;
 };
 
+// Per-process stats that are too expensive to read for every pid each cycle.
+struct CpuProcessExtendedStats {
+  unsigned long long io_read_bytes = 0;
+  unsigned long long io_write_bytes = 0;
+  unsigned long long voluntary_ctxt_switches = 0;
+  unsigned long long nonvoluntary_ctxt_switches = 0;
+  unsigned long long open_fds = 0;
+};
+
 struct CpuProcessMetrics {
   int pid = 0;
   std::string name;
+  // Start time in clock ticks since boot; tells reused pids apart.
+  unsigned long long start_time_ticks = 0;
   double cpu_time_seconds = 0.0;
+  // CPU usage in cores since the previous scan; 0 when first seen.
+  double cpu_rate_cores = 0.0;
   unsigned long long rss_bytes = 0;
+  // Extended stats are sampled on a budget, so they may lag the rest of the
+  // row by `extended_age_seconds`.
+  bool extended_available = false;
+  double extended_age_seconds = 0.0;
+  CpuProcessExtendedStats extended;
 };
 
-struct CpuTopProcesses {
-  std::vector<CpuProcessMetrics> processes;
+struct SummaryQuantile {
+  double quantile = 0.0;
+  double value = 0.0;
 };
 
-CpuMetrics CollectCpuMetrics();
-CpuTopProcesses CollectTopCpuProcesses(size_t max_processes);
+// Distribution of a per-process value over every scanned process.
+struct ProcessDistribution {
+  std::vector<SummaryQuantile> quantiles;
+  double sum = 0.0;
+  unsigned long long count = 0;
+};
 
-// Convenience accessors for individual metrics.
-double GetCpuLoad1m();
-unsigned long long GetNodeMemoryTotalBytes();
-unsigned long long GetNodeMemoryAvailableBytes();
-CpuTopProcesses GetCpuProcessCpuSecondsTotal(size_t max_processes);
-CpuTopProcesses GetCpuProcessRssBytes(size_t max_processes);
+// Full-population view computed in the same pass as the top-N scan.
+struct CpuProcessSummary {
+  unsigned long long process_count = 0;
+  unsigned long long thread_count = 0;
+  // Counts by /proc/<pid>/stat state (Linux only).
+  unsigned long long running = 0;
+  unsigned long long sleeping = 0;
+  unsigned long long disk_sleep = 0;
+  unsigned long long zombie = 0;
+  unsigned long long stopped = 0;
+  unsigned long long idle = 0;
+  // CPU usage in cores since the previous scan; processes first seen in this
+  // scan are not counted.
+  ProcessDistribution cpu_rate_cores;
+  ProcessDistribution rss_bytes;
+};
 
-// Returns overall node health score in range [0, 10].
-double GetNodeHealthScore();
-double ComputeNodeHealthScore(const CpuMetrics& metrics);
+struct CpuTopProcesses {
+  // The top N by CPU time, ordered by it; the exported set.
+  std::vector<CpuProcessMetrics> processes;
+  // The top N by resident memory, ordered by it, without extended stats.
+  // Not exported; serves the agent's RSS query.
+  std::vector<CpuProcessMetrics> processes_by_rss;
+  CpuProcessSummary summary;
+};
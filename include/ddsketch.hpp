@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-memory streaming quantile sketch (DDSketch) for non-negative values.
+// Quantiles are within `relative_accuracy` of the true value as long as the
+// data spans fewer than `max_bins` logarithmic buckets; beyond that the
+// lowest buckets are collapsed, so only the low quantiles lose accuracy.
+class DDSketch {
+ public:
+  DDSketch(double relative_accuracy, size_t max_bins);
+
+  void Add(double value);
+  // Returns the value at quantile `q` in [0, 1], or 0 when empty.
+  double Quantile(double q) const;
+  uint64_t count() const { return count_; }
+  double sum() const { return sum_; }
+
+ private:
+  int Index(double value) const;
+  double Value(int index) const;
+
+  double gamma_;
+  double log_gamma_;
+  size_t max_bins_;
+  // Values too small to bucket (including zero).
+  uint64_t zero_count_ = 0;
+  // bins_[i] counts values whose bucket index is min_index_ + i.
+  std::vector<uint64_t> bins_;
+  int min_index_ = 0;
+  uint64_t count_ = 0;
+  double sum_ = 0.0;
+};
@@ -18,9 +18,35 @@ struct GpuMetrics {
   unsigned int temperature_c = 0;
   bool power_available = false;
   double power_watts = 0.0;
+  // sysfs PCI address (e.g. "0000:3b:00.0") and the NUMA node it is
+  // attached to (-1 if unknown).
+  std::string pci_bus_id;
+  int numa_node = -1;
   std::vector<ProcMetrics> processes;
 };
 
-void InitializeGpuSubsystem();
+enum class GpuSubsystemState {
+  kDisabled,      // Built without NVML; CPU-only mode.
+  kInitializing,  // nvmlInit pending or retrying with backoff.
+  kReady,
+  kLost,          // A GPU fell off the bus; re-initialization is pending.
+};
+
+struct GpuSubsystemStatus {
+  GpuSubsystemState state = GpuSubsystemState::kDisabled;
+  unsigned long long init_attempts = 0;
+  unsigned long long reinitializations = 0;
+};
+
+// Starts NVML initialization on a background thread and returns at once.
+// Failed attempts are retried with exponential backoff, and a lost GPU
+// (NVML_ERROR_GPU_IS_LOST) triggers a re-initialization in place.
+void StartGpuSubsystem();
+// Stops the background thread and shuts NVML down; StartGpuSubsystem() may
+// be called again afterwards.
 void ShutdownGpuSubsystem();
+GpuSubsystemStatus GetGpuSubsystemStatus();
+// True once NVML is usable, or when NVML is disabled at build time.
+bool IsGpuSubsystemReady();
+// Returns no GPUs until the subsystem is ready.
 std::vector<GpuMetrics> CollectGpuMetrics();
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "cpu_metrics.hpp"
+
+// Weights and tuning for the node health score, loaded once at startup.
+struct HealthConfig {
+  // Component weights; normalized to sum to 1.
+  double cpu_weight = 0.5;
+  double memory_weight = 0.3;
+  double cpu_pressure_weight = 0.1;
+  double memory_pressure_weight = 0.1;
+  // Share of utilization (vs. load average) within the CPU component.
+  double cpu_utilization_share = 0.6;
+  // Half-life of the exponentially time-decayed input averages.
+  std::chrono::milliseconds half_life{30000};
+  // Opt-in: cgroup directory whose cpu.max / cpuset bound the CPU capacity,
+  // and whose CPU usage is then the load figure. Only the load is scoped:
+  // cpu_utilization, memory and the PSI inputs stay node-wide. Empty scores
+  // the whole node (load average over every online CPU) and honours no quota
+  // or cpuset.
+  std::string cgroup_path;
+};
+
+// Reads `key = value` lines (see config/health.conf). Unknown keys and
+// invalid values are errors.
+bool LoadHealthConfig(const std::string& path, HealthConfig* config);
+
+// Per-component sub-scores, each in [0, 1] (1 is healthy).
+struct HealthComponents {
+  double cpu = 0.0;
+  double memory = 0.0;
+  double cpu_pressure = 0.0;
+  double memory_pressure = 0.0;
+};
+
+struct HealthScore {
+  // 0-10 score of the latest sample alone.
+  double raw = 0.0;
+  // 0-10 score of the time-decayed averages of every input.
+  double smoothed = 0.0;
+  HealthComponents components;
+  HealthComponents smoothed_components;
+  // Effective CPU capacity: online CPUs, bounded by the configured cgroup.
+  double cpu_capacity_cores = 0.0;
+};
+
+// Stateful scorer: keeps an EWMA per input, updated incrementally with the
+// time elapsed since the previous sample, and a cached effective CPU capacity
+// that is re-parsed only when its cgroup files change. Not thread-safe; owned
+// by the refresher.
+class HealthScorer {
+ public:
+  explicit HealthScorer(HealthConfig config);
+  ~HealthScorer();
+  HealthScorer(const HealthScorer&) = delete;
+  HealthScorer& operator=(const HealthScorer&) = delete;
+
+  HealthScore Update(const CpuMetrics& metrics);
+
+ private:
+  // Health inputs normalized to [0, 1], except load_ratio (load per core of
+  // the scored scope).
+  struct Inputs {
+    double cpu_utilization = 0.0;
+    double load_ratio = 0.0;
+    double memory_available_ratio = 0.0;
+    double cpu_pressure = 0.0;
+    double memory_pressure = 0.0;
+  };
+  struct CapacityFiles;
+
+  double CpuCapacity();
+  bool ReadCgroupCpuSeconds(double* seconds);
+  // Returns false when `ratio` is only the node-wide fallback for a
+  // configured cgroup (no usage rate yet).
+  bool LoadRatio(const CpuMetrics& metrics,
+                 std::chrono::steady_clock::time_point now, double* ratio);
+  HealthComponents Score(const Inputs& inputs) const;
+  double Combine(const HealthComponents& components) const;
+
+  HealthConfig config_;
+  double total_weight_ = 1.0;
+  bool has_average_ = false;
+  // Whether average_.load_ratio has taken an in-scope sample.
+  bool has_average_load_ = false;
+  Inputs average_;
+  std::chrono::steady_clock::time_point last_update_;
+
+  std::unique_ptr<CapacityFiles> capacity_files_;
+  bool capacity_checked_ = false;
+  std::chrono::steady_clock::time_point last_capacity_check_;
+  // Contents of the files capacity_cores_ was derived from.
+  std::string capacity_source_;
+  double capacity_cores_ = 1.0;
+  double online_cores_ = 1.0;
+
+  bool has_cgroup_usage_ = false;
+  double prev_cgroup_seconds_ = 0.0;
+  std::chrono::steady_clock::time_point prev_cgroup_usage_at_;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+enum class MetricType : uint8_t {
+  kGauge,
+  kCounter,
+  kSummary,
+};
+
+struct MetricLabel {
+  std::string_view name;
+  std::string_view value;
+};
+
+// Format-neutral collection of metric families. Strings (family names, help,
+// label names and values) are interned once per batch and samples are stored
+// column-wise, so collectors append numbers and ids rather than rendering
+// text. Encoders (see prometheus.hpp) walk the batch in a single pass.
+class MetricBatch {
+ public:
+  using StringId = uint32_t;
+  using FamilyId = uint32_t;
+
+  struct Family {
+    StringId name = 0;
+    StringId help = 0;
+    MetricType type = MetricType::kGauge;
+  };
+
+  MetricBatch();
+
+  // Declares a family. Declaring an existing name returns its id, so the
+  // declaration order (not the sample order) is the exposition order.
+  FamilyId AddFamily(std::string_view name, std::string_view help,
+                     MetricType type);
+
+  void Add(FamilyId family, double value,
+           std::initializer_list<MetricLabel> labels = {});
+  // Adds a sample to a series named after the family plus `suffix`, e.g. a
+  // summary's "_sum" and "_count".
+  void AddSuffixed(FamilyId family, std::string_view suffix, double value,
+                   std::initializer_list<MetricLabel> labels = {});
+
+  // Appends `other`'s families and samples, merging families by name.
+  void Append(const MetricBatch& other);
+
+  size_t family_count() const { return families_.size(); }
+  const Family& family(FamilyId id) const { return families_[id]; }
+  std::string_view string(StringId id) const { return strings_[id]; }
+
+  size_t sample_count() const { return sample_family_.size(); }
+  FamilyId sample_family(size_t sample) const { return sample_family_[sample]; }
+  StringId sample_suffix(size_t sample) const { return sample_suffix_[sample]; }
+  double sample_value(size_t sample) const { return sample_value_[sample]; }
+  // Labels of a sample are label_name/label_value entries
+  // [sample_label_begin(i), sample_label_begin(i + 1)).
+  size_t sample_label_begin(size_t sample) const {
+    return sample_label_begin_[sample];
+  }
+  StringId label_name(size_t label) const { return label_names_[label]; }
+  StringId label_value(size_t label) const { return label_values_[label]; }
+
+ private:
+  StringId Intern(std::string_view value);
+  void AddSample(FamilyId family, StringId suffix, double value,
+                 std::initializer_list<MetricLabel> labels);
+
+  // std::deque keeps interned strings (and the views keying the index) at
+  // stable addresses as the table grows.
+  std::deque<std::string> strings_;
+  std::unordered_map<std::string_view, StringId> string_index_;
+  std::vector<Family> families_;
+  std::unordered_map<StringId, FamilyId> family_index_;
+
+  std::vector<FamilyId> sample_family_;
+  std::vector<StringId> sample_suffix_;
+  std::vector<double> sample_value_;
+  // One entry per sample plus a trailing end offset.
+  std::vector<uint32_t> sample_label_begin_;
+  std::vector<StringId> label_names_;
+  std::vector<StringId> label_values_;
+};
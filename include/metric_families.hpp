@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "collector_supervisor.hpp"
+#include "cpu_metrics.hpp"
+#include "gpu_metrics.hpp"
+#include "health_score.hpp"
+#include "metric_batch.hpp"
+#include "numa_metrics.hpp"
+#include "psi_triggers.hpp"
+
+// Self-observability of the agent itself, exported alongside node metrics.
+struct AgentMetrics {
+  PsiTriggerStats psi_triggers;
+  std::vector<CollectorStatus> collectors;
+  GpuSubsystemStatus gpu_subsystem;
+};
+
+// Metric family definitions for each data source.
+void AppendCpuFamilies(const CpuMetrics& cpu_metrics, MetricBatch* batch);
+void AppendHealthFamilies(const HealthScore& health, MetricBatch* batch);
+void AppendNumaFamilies(const std::vector<NumaNodeMetrics>& numa_nodes,
+                        MetricBatch* batch);
+void AppendProcessFamilies(const CpuTopProcesses& cpu_processes,
+                           MetricBatch* batch);
+void AppendGpuFamilies(const std::vector<GpuMetrics>& gpu_metrics,
+                       MetricBatch* batch);
+void AppendAgentFamilies(const AgentMetrics& agent_metrics,
+                         MetricBatch* batch);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+struct NumaNodeMetrics {
+  int node = 0;
+  // CPUs local to the node, in sysfs cpulist form (e.g. "0-15,32-47").
+  std::string cpulist;
+  unsigned int cpu_count = 0;
+  unsigned long long mem_total_bytes = 0;
+  unsigned long long mem_free_bytes = 0;
+  // Pages/s since the previous collection; unset on the first one.
+  bool rates_available = false;
+  double numa_miss_per_second = 0.0;
+  double numa_foreign_per_second = 0.0;
+};
+
+// NUMA node a PCI device (sysfs bus id, e.g. "0000:3b:00.0") is attached to,
+// or -1 if unknown. Results are cached per device.
+int GetPciDeviceNumaNode(const std::string& pci_bus_id);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "cpu_metrics.hpp"
+
+// Tiered scheduler for CpuProcessExtendedStats. The processes with the
+// highest current CPU rate are re-read every cycle and the rest round-robin
+// by pid, all within one
+// per-cycle budget of sampled processes and time; cached samples are served
+// with their age. The cost per cycle is bounded regardless of the process
+// count.
+class ExtendedStatsSampler {
+ public:
+  ExtendedStatsSampler(size_t hot_count, size_t processes_per_cycle,
+                       std::chrono::milliseconds time_budget);
+
+  // `processes` is the exported set, in any order. Fills the extended stats of each process that has a sample; samples of processes
+  // outside the set are dropped.
+  void Sample(std::vector<CpuProcessMetrics>* processes);
+
+ private:
+  struct CachedStats {
+    unsigned long long start_time_ticks = 0;
+    std::chrono::steady_clock::time_point sampled_at;
+    CpuProcessExtendedStats stats;
+  };
+
+  bool ReadInto(const CpuProcessMetrics& proc,
+                std::chrono::steady_clock::time_point now);
+
+  size_t hot_count_;
+  size_t processes_per_cycle_;
+  std::chrono::milliseconds time_budget_;
+  std::unordered_map<int, CachedStats> cache_;
+  // Last tail pid sampled; the next cycle resumes after it.
+  int tail_cursor_ = 0;
+};
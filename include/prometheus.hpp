@@ -1,12 +1,38 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
+#include <string_view>
 #include <vector>
 
-#include "cpu_metrics.hpp"
-#include "gpu_metrics.hpp"
+#include "metric_batch.hpp"
 
-void FormatPrometheus(const CpuMetrics& cpu_metrics,
-                      const CpuTopProcesses& cpu_processes,
-                      const std::vector<GpuMetrics>& gpu_metrics,
-                      std::string* out);
+// Byte range of one metric family within a rendered exposition.
+struct MetricFamilyRange {
+  std::string name;
+  size_t offset = 0;
+  size_t length = 0;
+};
+
+// Rendered exposition plus an index of its families, in exposition order.
+// Each family is contiguous, so a filtered scrape is a gather of slices.
+struct MetricsSnapshot {
+  std::string text;
+  std::vector<MetricFamilyRange> families;
+};
+
+// Appends `value` escaped for use inside a quoted label value.
+void AppendEscapedLabelValue(std::string* out, std::string_view value);
+
+// Appends a sample value; integral values (counts, bytes) are rendered
+// without a fraction.
+void AppendSampleValue(std::string* out, double value);
+
+// Renders `batch` as Prometheus text exposition, families in declaration
+// order. Families without samples are omitted.
+void EncodePrometheusText(const MetricBatch& batch, MetricsSnapshot* snapshot);
+
+// Returns the families matching any of `names`, in exposition order. A name
+// ending in '*' matches by prefix (e.g. "gpu_*").
+std::vector<MetricFamilyRange> SelectMetricFamilies(
+    const MetricsSnapshot& snapshot, const std::vector<std::string>& names);
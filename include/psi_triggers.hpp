@@ -0,0 +1,19 @@
+#pragma once
+
+#include <functional>
+
+struct PsiTriggerStats {
+  bool active = false;
+  unsigned long long cpu_events = 0;
+  unsigned long long memory_events = 0;
+  unsigned long long io_events = 0;
+};
+
+// Registers kernel PSI triggers on /proc/pressure/{cpu,memory,io} and waits
+// on them from a dedicated thread. `on_trigger` runs on that thread each time
+// any trigger fires, so it should only signal the refresher. Falls back to
+// interval polling (returns false) when no trigger could be registered.
+bool StartPsiTriggerWatcher(std::function<void()> on_trigger);
+// Stops and joins the watcher; `on_trigger` is not called afterwards.
+void StopPsiTriggerWatcher();
+PsiTriggerStats GetPsiTriggerStats();
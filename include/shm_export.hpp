@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "cpu_metrics.hpp"
+#include "gpu_metrics.hpp"
+#include "health_score.hpp"
+#include "shm_snapshot.hpp"
+
+// Publishes snapshots into the shared-memory layout of shm_snapshot.hpp.
+// Only one writer may publish to a given path; Open() enforces this with an
+// exclusive flock held until destruction.
+class ShmSnapshotWriter {
+ public:
+  ShmSnapshotWriter() = default;
+  ShmSnapshotWriter(const ShmSnapshotWriter&) = delete;
+  ShmSnapshotWriter& operator=(const ShmSnapshotWriter&) = delete;
+  ~ShmSnapshotWriter();
+
+  // Creates or reuses the file at `path`. An existing file is kept (and its
+  // generation continued) so that mapped readers survive agent restarts.
+  // Fails if another writer holds the file.
+  bool Open(const std::string& path);
+  // Unmaps the file and releases the lock; Publish() is a no-op until the
+  // next Open().
+  void Close();
+
+  void Publish(const CpuMetrics& cpu_metrics, const HealthScore& health,
+               const CpuTopProcesses& cpu_processes,
+               const std::vector<GpuMetrics>& gpu_metrics);
+
+ private:
+  int fd_ = -1;
+  ShmSnapshotFile* file_ = nullptr;
+  ShmSnapshotData staging_{};
+};
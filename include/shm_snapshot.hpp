@@ -0,0 +1,192 @@
+#pragma once
+
+// Shared-memory snapshot layout and a header-only reader for co-located
+// consumers. The agent republishes each snapshot into a fixed binary layout
+// guarded by a seqlock: readers copy the data and retry if the sequence
+// changed underneath them, so reads are lock-free and need no syscalls once
+// the file is mapped.
+//
+//   ShmSnapshotReader reader;
+//   ShmNodeMetrics node;
+//   if (reader.Open() && reader.ReadNode(&node)) { ... node.health_score ... }
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __APPLE__
+constexpr const char* kShmSnapshotPath = "/tmp/node-metrics-agent.shm";
+#else
+constexpr const char* kShmSnapshotPath = "/dev/shm/node-metrics-agent";
+#endif
+
+constexpr uint64_t kShmSnapshotMagic = 0x5350414e53414d4eULL;  // "NMASNAPS"
+constexpr uint32_t kShmSnapshotVersion = 2;
+constexpr size_t kShmMaxGpus = 16;
+constexpr size_t kShmMaxProcesses = 100;
+constexpr size_t kShmProcessNameSize = 32;
+
+struct ShmNodeMetrics {
+  double load_1m;
+  double cpu_utilization;
+  double cpu_pressure_avg10;
+  double memory_pressure_avg10;
+  double io_pressure_avg10;
+  double health_score;
+  uint64_t mem_total_bytes;
+  uint64_t mem_available_bytes;
+  double health_score_smoothed;  // Added in version 2.
+  double cpu_capacity_cores;     // Added in version 2.
+};
+
+struct ShmGpuMetrics {
+  uint32_t index;
+  uint32_t utilization_percent;
+  uint32_t temperature_c;
+  uint32_t power_available;
+  double power_watts;
+  uint64_t memory_used_bytes;
+  uint64_t memory_total_bytes;
+};
+
+struct ShmProcessMetrics {
+  int32_t pid;
+  uint32_t reserved;
+  double cpu_time_seconds;
+  uint64_t rss_bytes;
+  char name[kShmProcessNameSize];  // NUL-terminated, truncated.
+};
+
+struct ShmSnapshotData {
+  int64_t timestamp_unix_nanos;
+  uint32_t gpu_count;
+  uint32_t process_count;
+  ShmNodeMetrics node;
+  ShmGpuMetrics gpus[kShmMaxGpus];
+  ShmProcessMetrics processes[kShmMaxProcesses];
+};
+
+struct ShmSnapshotHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t data_size;
+  // Odd while the writer is updating `data`; each publish adds 2, so
+  // sequence / 2 is the snapshot generation.
+  std::atomic<uint64_t> sequence;
+};
+
+struct ShmSnapshotFile {
+  ShmSnapshotHeader header;
+  ShmSnapshotData data;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "seqlock needs an address-free 64-bit atomic");
+
+class ShmSnapshotReader {
+ public:
+  ShmSnapshotReader() = default;
+  ShmSnapshotReader(const ShmSnapshotReader&) = delete;
+  ShmSnapshotReader& operator=(const ShmSnapshotReader&) = delete;
+  ~ShmSnapshotReader() { Close(); }
+
+  // Maps the snapshot file read-only. Fails if the agent has not created it
+  // yet or it was written by an incompatible layout version. May be called
+  // again to remap after reads fail because the agent changed the layout.
+  bool Open(const char* path = kShmSnapshotPath) {
+    Close();
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st {};
+    if (fstat(fd, &st) != 0 ||
+        static_cast<size_t>(st.st_size) < sizeof(ShmSnapshotFile)) {
+      close(fd);
+      return false;
+    }
+    void* mapped =
+        mmap(nullptr, sizeof(ShmSnapshotFile), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+      return false;
+    }
+    const auto* file = static_cast<const ShmSnapshotFile*>(mapped);
+    if (!HasCurrentLayout(file->header)) {
+      munmap(mapped, sizeof(ShmSnapshotFile));
+      return false;
+    }
+    file_ = file;
+    return true;
+  }
+
+  void Close() {
+    if (file_) {
+      munmap(const_cast<ShmSnapshotFile*>(file_), sizeof(ShmSnapshotFile));
+      file_ = nullptr;
+    }
+  }
+
+  // Number of snapshots published so far; changes when new data is ready.
+  uint64_t Generation() const {
+    return file_ ? file_->header.sequence.load(std::memory_order_acquire) / 2
+                 : 0;
+  }
+
+  bool Read(ShmSnapshotData* out) const {
+    return file_ && ReadConsistent(&file_->data, out);
+  }
+
+  // Copies only the node block; cheaper than a full Read(). Like Read(),
+  // fails once the writer has switched the file to another layout; Open()
+  // again to pick it up.
+  bool ReadNode(ShmNodeMetrics* out) const {
+    return file_ && ReadConsistent(&file_->data.node, out);
+  }
+
+ private:
+  static constexpr int kMaxReadAttempts = 1000;
+
+  static bool HasCurrentLayout(const ShmSnapshotHeader& header) {
+    return header.magic == kShmSnapshotMagic &&
+           header.version == kShmSnapshotVersion &&
+           header.data_size == sizeof(ShmSnapshotData);
+  }
+
+  template <typename T>
+  bool ReadConsistent(const T* source, T* out) const {
+    if (!out) {
+      return false;
+    }
+    const std::atomic<uint64_t>& sequence = file_->header.sequence;
+    for (int attempt = 0; attempt < kMaxReadAttempts; ++attempt) {
+      const uint64_t before = sequence.load(std::memory_order_acquire);
+      if (before == 0) {
+        return false;  // Nothing published yet.
+      }
+      if ((before & 1) != 0) {
+        continue;
+      }
+      std::memcpy(static_cast<void*>(out), source, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      // A restarted agent may have rewritten the header for another layout
+      // since Open(); the copy is then meaningless even if the sequence
+      // happens to match.
+      if (!HasCurrentLayout(file_->header)) {
+        return false;
+      }
+      if (sequence.load(std::memory_order_relaxed) == before) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  const ShmSnapshotFile* file_ = nullptr;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Which collector a checkpointed baseline belongs to. Values are persisted,
+// so never renumber them.
+enum class CounterKind : uint32_t {
+  kCpuTotals = 1,       // values: {total jiffies, idle jiffies}
+  kProcessCpuTime = 2,  // key: pid, identity: start time; values: {cpu ns}
+  kNumaEvents = 3,      // key: NUMA node; values: {numa_miss, numa_foreign}
+};
+
+// A counter baseline checkpointed across agent restarts.
+struct CounterBaseline {
+  CounterKind kind = CounterKind::kCpuTotals;
+  uint32_t reserved = 0;
+  uint64_t key = 0;
+  // Distinguishes reused keys (e.g. process start time for a pid).
+  uint64_t identity = 0;
+  uint64_t values[2] = {0, 0};
+};
+
+// Persists counter baselines in a small mmap'd file so a restarted agent can
+// compute correct deltas in its first cycle. Baselines are only restored
+// when the file was written during the current boot (matching boot id) and
+// recently enough to still be meaningful.
+class CounterStateStore {
+ public:
+  CounterStateStore() = default;
+  CounterStateStore(const CounterStateStore&) = delete;
+  CounterStateStore& operator=(const CounterStateStore&) = delete;
+  ~CounterStateStore();
+
+  // Maps (creating if needed) the state file and loads any valid baselines.
+  // Reopening replaces the previous mapping.
+  bool Open(const std::string& path);
+
+  const std::vector<CounterBaseline>& restored() const { return restored_; }
+  // Wall-clock time the restored baselines were checkpointed.
+  std::chrono::system_clock::time_point restored_at() const {
+    return restored_at_;
+  }
+
+  // Overwrites the checkpoint; baselines beyond the file capacity are
+  // dropped.
+  void Checkpoint(const std::vector<CounterBaseline>& baselines);
+
+ private:
+  struct FileLayout;
+
+  FileLayout* file_ = nullptr;
+  size_t mapped_size_ = 0;
+  std::string boot_id_;
+  std::vector<CounterBaseline> restored_;
+  std::chrono::system_clock::time_point restored_at_;
+};
@@ -1,5 +1,31 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 std::string ReadFile(const std::string& path);
+
+// Parses a sysfs list such as "0-3,8,10-11".
+std::vector<int> ParseList(const std::string& list);
+
+#ifdef __linux__
+// A sysfs or cgroupfs file kept open across cycles and re-read with pread,
+// which skips the path lookup and open/close of a fresh read.
+class CachedFile {
+ public:
+  explicit CachedFile(const std::string& path);
+  ~CachedFile();
+  CachedFile(const CachedFile&) = delete;
+  CachedFile& operator=(const CachedFile&) = delete;
+
+  bool is_open() const { return fd_ >= 0; }
+  bool Read(std::string* out) const;
+  // Closes and opens the path again, e.g. when it did not exist yet or its
+  // cgroup was recreated.
+  bool Reopen();
+
+ private:
+  std::string path_;
+  int fd_;
+};
+#endif
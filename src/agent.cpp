@@ -0,0 +1,294 @@
+#include "agent.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "collector_registry.hpp"
+#include "collectors.hpp"
+#include "psi_triggers.hpp"
+#include "shm_export.hpp"
+#include "state_store.hpp"
+
+namespace {
+
+constexpr std::chrono::milliseconds kCpuCollectorTimeout{500};
+constexpr std::chrono::milliseconds kNumaCollectorTimeout{500};
+constexpr std::chrono::milliseconds kProcessCollectorTimeout{1000};
+constexpr std::chrono::milliseconds kGpuCollectorTimeout{1000};
+constexpr std::chrono::seconds kStateCheckpointInterval{10};
+
+struct Collectors {
+  explicit Collectors(size_t top_process_count) {
+    cpu = registry.Register<CpuMetrics>("cpu", CollectCpuMetrics,
+                                        AppendCpuFamilies,
+                                        kCpuCollectorTimeout);
+    numa = registry.Register<std::vector<NumaNodeMetrics>>(
+        "numa", CollectNumaMetrics, AppendNumaFamilies, kNumaCollectorTimeout);
+    processes = registry.Register<CpuTopProcesses>(
+        "processes",
+        [top_process_count] {
+          return CollectTopCpuProcesses(top_process_count);
+        },
+        AppendProcessFamilies, kProcessCollectorTimeout);
+    gpu = registry.Register<std::vector<GpuMetrics>>(
+        "gpu", CollectGpuMetrics, AppendGpuFamilies, kGpuCollectorTimeout);
+  }
+
+  CollectorRegistry registry;
+  // Typed handles for the PSI fast path and the published snapshot.
+  TypedCollector<CpuMetrics>* cpu = nullptr;
+  TypedCollector<std::vector<NumaNodeMetrics>>* numa = nullptr;
+  TypedCollector<CpuTopProcesses>* processes = nullptr;
+  TypedCollector<std::vector<GpuMetrics>>* gpu = nullptr;
+};
+
+std::shared_ptr<const AgentSnapshot> MakeEmptySnapshot() {
+  auto snapshot = std::make_shared<AgentSnapshot>();
+  snapshot->cpu = std::make_shared<const CpuMetrics>();
+  snapshot->processes = std::make_shared<const CpuTopProcesses>();
+  snapshot->numa = std::make_shared<const std::vector<NumaNodeMetrics>>();
+  snapshot->gpus = std::make_shared<const std::vector<GpuMetrics>>();
+  snapshot->exposition = std::make_shared<const MetricsSnapshot>();
+  return snapshot;
+}
+
+// Only used by the refresher thread once set up in StartAgent().
+AgentOptions g_options;
+ShmSnapshotWriter g_shm_writer;
+CounterStateStore g_state_store;
+std::unique_ptr<HealthScorer> g_health_scorer;
+// CPU sample the latest score came from; a sample is scored only once so a
+// stale collector does not skew the smoothed inputs.
+std::shared_ptr<const CpuMetrics> g_scored_cpu;
+HealthScore g_health;
+std::shared_ptr<Collectors> g_collectors;
+std::thread g_refresher;
+bool g_started = false;
+
+std::mutex g_snapshot_mutex;
+std::shared_ptr<const AgentSnapshot> g_snapshot = MakeEmptySnapshot();
+
+// Guards the refresher wake-ups below.
+std::mutex g_refresh_mutex;
+std::condition_variable g_refresh_cv;
+bool g_pressure_refresh_pending = false;
+bool g_stop_requested = false;
+
+// Called from the PSI watcher thread; only wakes the refresher.
+void RequestPressureRefresh() {
+  {
+    std::lock_guard<std::mutex> lock(g_refresh_mutex);
+    g_pressure_refresh_pending = true;
+  }
+  g_refresh_cv.notify_one();
+}
+
+enum class WakeReason { kDeadline, kPressure, kStop };
+
+// Sleeps until `deadline` unless a PSI trigger fires or a stop is requested.
+WakeReason WaitForWake(std::chrono::steady_clock::time_point deadline) {
+  std::unique_lock<std::mutex> lock(g_refresh_mutex);
+  g_refresh_cv.wait_until(lock, deadline, [] {
+    return g_pressure_refresh_pending || g_stop_requested;
+  });
+  if (g_stop_requested) {
+    return WakeReason::kStop;
+  }
+  const bool triggered = g_pressure_refresh_pending;
+  g_pressure_refresh_pending = false;
+  return triggered ? WakeReason::kPressure : WakeReason::kDeadline;
+}
+
+void PublishMetrics(const Collectors& collectors) {
+  const std::shared_ptr<const AgentSnapshot> previous = GetAgentSnapshot();
+  auto snapshot = std::make_shared<AgentSnapshot>();
+  snapshot->generation = previous->generation + 1;
+  snapshot->published_at = std::chrono::system_clock::now();
+  snapshot->cpu = collectors.cpu->LastGood();
+  snapshot->numa = collectors.numa->LastGood();
+  snapshot->processes = collectors.processes->LastGood();
+  snapshot->gpus = collectors.gpu->LastGood();
+  // Until the CPU collector has produced a sample there is nothing to score;
+  // a score of the zero-valued placeholder would look plausible.
+  const bool has_cpu = collectors.cpu->HasSample();
+  if (has_cpu && snapshot->cpu != g_scored_cpu) {
+    g_health = g_health_scorer->Update(*snapshot->cpu);
+    g_scored_cpu = snapshot->cpu;
+  }
+  snapshot->health = g_health;
+
+  AgentMetrics& agent_metrics = snapshot->agent;
+  agent_metrics.psi_triggers = GetPsiTriggerStats();
+  agent_metrics.collectors = collectors.registry.Statuses();
+  agent_metrics.gpu_subsystem = GetGpuSubsystemStatus();
+  snapshot->not_ready_reason = nullptr;
+  if (!IsGpuSubsystemReady()) {
+    snapshot->not_ready_reason = "gpu subsystem not ready";
+  }
+  for (const auto& status : agent_metrics.collectors) {
+    if (status.stale) {
+      snapshot->not_ready_reason = "degraded: stale collectors";
+    }
+  }
+  if (!has_cpu) {
+    snapshot->not_ready_reason = "no cpu sample yet";
+  }
+
+  // Snapshots are immutable once published: readers keep the one they
+  // started with while the next one is built.
+  MetricBatch batch;
+  collectors.registry.AppendBatches(&batch);
+  if (has_cpu) {
+    AppendHealthFamilies(snapshot->health, &batch);
+  }
+  AppendAgentFamilies(agent_metrics, &batch);
+  auto exposition = std::make_shared<MetricsSnapshot>();
+  exposition->text.reserve(previous->exposition->text.size() + 4 * 1024);
+  EncodePrometheusText(batch, exposition.get());
+  snapshot->exposition = std::move(exposition);
+
+  if (has_cpu) {
+    g_shm_writer.Publish(*snapshot->cpu, snapshot->health,
+                         *snapshot->processes, *snapshot->gpus);
+  }
+  std::shared_ptr<const AgentSnapshot> published = std::move(snapshot);
+  {
+    std::lock_guard<std::mutex> lock(g_snapshot_mutex);
+    g_snapshot = published;
+  }
+  if (g_options.on_publish) {
+    g_options.on_publish(published);
+  }
+}
+
+void CheckpointCounterState() {
+  std::vector<CounterBaseline> baselines;
+  SaveCpuCounterBaselines(&baselines);
+  SaveNumaCounterBaselines(&baselines);
+  g_state_store.Checkpoint(baselines);
+}
+
+void RefreshMetricsLoop(std::shared_ptr<Collectors> collectors) {
+  auto next_checkpoint = std::chrono::steady_clock::now();
+  while (true) {
+    if (std::chrono::steady_clock::now() >= next_checkpoint) {
+      CheckpointCounterState();
+      next_checkpoint += kStateCheckpointInterval;
+    }
+
+    // A PSI trigger only refreshes the health-score inputs; the process and
+    // GPU views are reused until the next full refresh is due.
+    const auto next_full_refresh =
+        std::chrono::steady_clock::now() + g_options.refresh_interval;
+    WakeReason reason;
+    while ((reason = WaitForWake(next_full_refresh)) == WakeReason::kPressure) {
+      collectors->cpu->Refresh();
+      PublishMetrics(*collectors);
+    }
+    if (reason == WakeReason::kStop) {
+      return;
+    }
+    collectors->registry.RefreshAll();
+    PublishMetrics(*collectors);
+  }
+}
+
+// Copies the first `max_processes` of a list ranked at collection time.
+CpuTopProcesses FirstProcesses(const CpuTopProcesses& all,
+                               const std::vector<CpuProcessMetrics>& ranked,
+                               size_t max_processes) {
+  CpuTopProcesses result;
+  result.summary = all.summary;
+  result.processes.assign(
+      ranked.begin(),
+      ranked.begin() + std::min(max_processes, ranked.size()));
+  return result;
+}
+
+}  // namespace
+
+bool StartAgent(const AgentOptions& options) {
+  if (g_started) {
+    return false;
+  }
+  g_started = true;
+  g_options = options;
+  g_health_scorer = std::make_unique<HealthScorer>(options.health);
+  g_scored_cpu.reset();
+  {
+    std::lock_guard<std::mutex> lock(g_refresh_mutex);
+    g_stop_requested = false;
+    g_pressure_refresh_pending = false;
+  }
+
+  StartGpuSubsystem();
+  if (!options.shm_path.empty()) {
+    g_shm_writer.Open(options.shm_path);
+  }
+  if (!options.state_path.empty() && g_state_store.Open(options.state_path)) {
+    RestoreCpuCounterBaselines(g_state_store.restored(),
+                               g_state_store.restored_at());
+    RestoreNumaCounterBaselines(g_state_store.restored(),
+                                g_state_store.restored_at());
+  }
+  g_collectors = std::make_shared<Collectors>(options.top_process_count);
+  g_collectors->registry.RefreshAll();
+  PublishMetrics(*g_collectors);
+  g_refresher = std::thread(RefreshMetricsLoop, g_collectors);
+  StartPsiTriggerWatcher(RequestPressureRefresh);
+  return true;
+}
+
+void StopAgent() {
+  if (!g_refresher.joinable()) {
+    return;
+  }
+  StopPsiTriggerWatcher();
+  {
+    std::lock_guard<std::mutex> lock(g_refresh_mutex);
+    g_stop_requested = true;
+  }
+  g_refresh_cv.notify_all();
+  g_refresher.join();
+  CheckpointCounterState();
+  g_collectors.reset();
+  g_shm_writer.Close();
+  ShutdownGpuSubsystem();
+  g_started = false;
+}
+
+std::shared_ptr<const AgentSnapshot> GetAgentSnapshot() {
+  std::lock_guard<std::mutex> lock(g_snapshot_mutex);
+  return g_snapshot;
+}
+
+double GetCpuLoad1m() { return GetAgentSnapshot()->cpu->load_1m; }
+
+unsigned long long GetNodeMemoryTotalBytes() {
+  return GetAgentSnapshot()->cpu->mem_total_bytes;
+}
+
+unsigned long long GetNodeMemoryAvailableBytes() {
+  return GetAgentSnapshot()->cpu->mem_available_bytes;
+}
+
+double GetNodeHealthScore() { return GetAgentSnapshot()->health.raw; }
+
+double GetNodeHealthScoreSmoothed() {
+  return GetAgentSnapshot()->health.smoothed;
+}
+
+CpuTopProcesses GetCpuProcessCpuSecondsTotal(size_t max_processes) {
+  const std::shared_ptr<const AgentSnapshot> snapshot = GetAgentSnapshot();
+  const CpuTopProcesses& all = *snapshot->processes;
+  return FirstProcesses(all, all.processes, max_processes);
+}
+
+CpuTopProcesses GetCpuProcessRssBytes(size_t max_processes) {
+  const std::shared_ptr<const AgentSnapshot> snapshot = GetAgentSnapshot();
+  const CpuTopProcesses& all = *snapshot->processes;
+  return FirstProcesses(all, all.processes_by_rss, max_processes);
+}
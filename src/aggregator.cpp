@@ -0,0 +1,511 @@
+#include "aggregator.hpp"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+constexpr size_t kMaxAgentResponseBytes = 16 * 1024 * 1024;
+
+struct Quantile {
+  double value;
+  const char* label;
+};
+constexpr Quantile kHealthScoreQuantiles[] = {
+    {0.0, "0"}, {0.1, "0.1"}, {0.5, "0.5"}, {0.9, "0.9"}, {1.0, "1"}};
+
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+enum class ConnectionPhase { kConnecting, kSending, kReceiving };
+enum class ConnectionState { kPending, kDone, kFailed };
+
+struct Connection {
+  size_t target_index = 0;
+  int fd = -1;
+  ConnectionPhase phase = ConnectionPhase::kConnecting;
+  std::string request;
+  size_t sent = 0;
+  std::string response;
+  std::chrono::steady_clock::time_point started;
+};
+
+bool SplitHostPort(const std::string& target, std::string* host,
+                   std::string* port) {
+  size_t colon = target.rfind(':');
+  if (colon == std::string::npos || colon == 0 || colon + 1 == target.size()) {
+    return false;
+  }
+  *host = target.substr(0, colon);
+  if (host->size() > 2 && host->front() == '[' && host->back() == ']') {
+    *host = host->substr(1, host->size() - 2);
+  }
+  *port = target.substr(colon + 1);
+  return true;
+}
+
+// Parses the value of an exposition sample whose name ends at `name_end`.
+// Skips the label set (whose quoted values may contain spaces, braces and
+// escapes) so that an optional trailing timestamp is not taken as the value.
+bool ParseSampleValue(const std::string& line, size_t name_end,
+                      double* value) {
+  size_t pos = name_end;
+  if (line[pos] == '{') {
+    bool quoted = false;
+    for (++pos; pos < line.size(); ++pos) {
+      if (quoted && line[pos] == '\\') {
+        ++pos;
+      } else if (line[pos] == '"') {
+        quoted = !quoted;
+      } else if (!quoted && line[pos] == '}') {
+        break;
+      }
+    }
+    if (pos >= line.size()) {
+      return false;
+    }
+    ++pos;
+  }
+  pos = line.find_first_not_of(' ', pos);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  char* end = nullptr;
+  *value = std::strtod(line.c_str() + pos, &end);
+  return end != line.c_str() + pos;
+}
+
+bool ExtractHttpBody(const std::string& response, std::string* body) {
+  if (response.compare(0, 12, "HTTP/1.1 200") != 0 &&
+      response.compare(0, 12, "HTTP/1.0 200") != 0) {
+    return false;
+  }
+  size_t header_end = response.find("\r\n\r\n");
+  if (header_end == std::string::npos) {
+    return false;
+  }
+  *body = response.substr(header_end + 4);
+  return true;
+}
+
+ConnectionState Advance(Connection* conn, short revents) {
+  if (conn->phase == ConnectionPhase::kConnecting) {
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0 ||
+        error != 0) {
+      return ConnectionState::kFailed;
+    }
+    conn->phase = ConnectionPhase::kSending;
+  }
+
+  if (conn->phase == ConnectionPhase::kSending) {
+    ssize_t sent = send(conn->fd, conn->request.data() + conn->sent,
+                        conn->request.size() - conn->sent, kSendFlags);
+    if (sent < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR
+                 ? ConnectionState::kPending
+                 : ConnectionState::kFailed;
+    }
+    conn->sent += static_cast<size_t>(sent);
+    if (conn->sent == conn->request.size()) {
+      conn->phase = ConnectionPhase::kReceiving;
+    }
+    return ConnectionState::kPending;
+  }
+
+  if (!(revents & (POLLIN | POLLHUP | POLLERR))) {
+    return ConnectionState::kPending;
+  }
+  char buffer[64 * 1024];
+  while (true) {
+    ssize_t bytes = recv(conn->fd, buffer, sizeof(buffer), 0);
+    if (bytes == 0) {
+      return ConnectionState::kDone;
+    }
+    if (bytes < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK ? ConnectionState::kPending
+                                                     : ConnectionState::kFailed;
+    }
+    conn->response.append(buffer, static_cast<size_t>(bytes));
+    if (conn->response.size() > kMaxAgentResponseBytes) {
+      return ConnectionState::kFailed;
+    }
+  }
+}
+
+struct MergedFamily {
+  std::string name;
+  std::string text;
+};
+
+// Returned family buffers stay valid as more families are added.
+class FamilyMerger {
+ public:
+  std::string* Family(const std::string& name) {
+    auto it = index_.find(name);
+    if (it == index_.end()) {
+      it = index_.emplace(name, families_.size()).first;
+      families_.push_back({name, std::string()});
+    }
+    return &families_[it->second].text;
+  }
+
+  void Render(MetricsSnapshot* snapshot) const {
+    for (const auto& family : families_) {
+      if (family.text.empty()) {
+        continue;
+      }
+      snapshot->families.push_back(
+          {family.name, snapshot->text.size(), family.text.size()});
+      snapshot->text.append(family.text);
+    }
+  }
+
+ private:
+  std::deque<MergedFamily> families_;
+  std::unordered_map<std::string, size_t> index_;
+};
+
+// Appends "{node=\"<target>\"" without the closing brace.
+void AppendNodeLabel(std::string* out, const std::string& node) {
+  out->append("{node=\"");
+  AppendEscapedLabelValue(out, node);
+  out->push_back('"');
+}
+
+// Copies the label set opening at `line[open]` after the node label. An
+// upstream `node` label is renamed to `exported_node` so that label names
+// stay unique. Returns the position past the closing '}'.
+size_t AppendUpstreamLabels(const std::string& line, size_t open,
+                            std::string* out) {
+  bool quoted = false;
+  bool at_name = true;
+  size_t pos = open + 1;
+  for (; pos < line.size(); ++pos) {
+    const char c = line[pos];
+    if (quoted) {
+      out->push_back(c);
+      if (c == '\\' && pos + 1 < line.size()) {
+        out->push_back(line[++pos]);
+      } else if (c == '"') {
+        quoted = false;
+      }
+      continue;
+    }
+    if (c == '}') {
+      break;
+    }
+    if (c == ',') {
+      at_name = true;
+      continue;
+    }
+    if (at_name) {
+      if (c == ' ') {
+        continue;
+      }
+      out->push_back(',');
+      if (line.compare(pos, 5, "node=") == 0) {
+        out->append("exported_");
+      }
+      at_name = false;
+    }
+    if (c == '"') {
+      quoted = true;
+    }
+    out->push_back(c);
+  }
+  out->push_back('}');
+  return pos + 1;
+}
+
+void AppendNodeSample(std::string* out, const std::string& name,
+                      const std::string& node, double value) {
+  out->append(name);
+  AppendNodeLabel(out, node);
+  out->append("} ");
+  AppendSampleValue(out, value);
+  out->push_back('\n');
+}
+
+void AppendClusterSample(std::string* out, const char* name, double value) {
+  out->append(name);
+  out->push_back(' ');
+  AppendSampleValue(out, value);
+  out->push_back('\n');
+}
+
+double NearestRankQuantile(const std::vector<double>& sorted, double q) {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  size_t rank = static_cast<size_t>(std::ceil(q * sorted.size()));
+  return sorted[rank == 0 ? 0 : std::min(rank, sorted.size()) - 1];
+}
+
+}  // namespace
+
+AgentScraper::AgentScraper(AggregatorOptions options)
+    : options_(std::move(options)) {}
+
+bool AgentScraper::Resolve(const std::string& target, ResolvedAddress* out) {
+  auto it = resolved_.find(target);
+  if (it != resolved_.end()) {
+    *out = it->second;
+    return true;
+  }
+
+  std::string host;
+  std::string port;
+  if (!SplitHostPort(target, &host, &port)) {
+    std::cerr << "Aggregator: invalid target " << target << std::endl;
+    return false;
+  }
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* info = nullptr;
+  int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &info);
+  if (rc != 0 || !info) {
+    std::cerr << "Aggregator: failed to resolve " << target << ": "
+              << gai_strerror(rc) << std::endl;
+    return false;
+  }
+  std::memcpy(&out->addr, info->ai_addr, info->ai_addrlen);
+  out->addr_len = info->ai_addrlen;
+  freeaddrinfo(info);
+  resolved_[target] = *out;
+  return true;
+}
+
+std::vector<AgentScrapeResult> AgentScraper::ScrapeAll() {
+  const std::vector<std::string>& targets = options_.targets;
+  std::vector<AgentScrapeResult> results(targets.size());
+  for (size_t i = 0; i < targets.size(); ++i) {
+    results[i].target = targets[i];
+  }
+
+  const auto finish = [this, &results](Connection* conn, bool ok) {
+    AgentScrapeResult& result = results[conn->target_index];
+    result.duration_seconds = std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() -
+                                  conn->started)
+                                  .count();
+    result.up = ok && ExtractHttpBody(conn->response, &result.body);
+    if (!result.up) {
+      resolved_.erase(result.target);
+    }
+    if (conn->fd >= 0) {
+      close(conn->fd);
+      conn->fd = -1;
+    }
+  };
+
+  const size_t max_parallel = std::max<size_t>(1, options_.max_parallel);
+  std::vector<Connection> active;
+  std::vector<pollfd> fds;
+  size_t next = 0;
+  while (next < targets.size() || !active.empty()) {
+    while (next < targets.size() && active.size() < max_parallel) {
+      Connection conn;
+      conn.target_index = next++;
+      conn.started = std::chrono::steady_clock::now();
+      const std::string& target = targets[conn.target_index];
+      conn.request = "GET /metrics HTTP/1.1\r\nHost: " + target +
+                     "\r\nConnection: close\r\n\r\n";
+
+      ResolvedAddress address;
+      if (!Resolve(target, &address)) {
+        finish(&conn, false);
+        continue;
+      }
+      conn.fd = socket(address.addr.ss_family, SOCK_STREAM, 0);
+      if (conn.fd < 0) {
+        finish(&conn, false);
+        continue;
+      }
+      fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL, 0) | O_NONBLOCK);
+      fcntl(conn.fd, F_SETFD, FD_CLOEXEC);
+      if (connect(conn.fd, reinterpret_cast<sockaddr*>(&address.addr),
+                  address.addr_len) < 0 &&
+          errno != EINPROGRESS) {
+        finish(&conn, false);
+        continue;
+      }
+      active.push_back(std::move(conn));
+    }
+    if (active.empty()) {
+      continue;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto earliest_deadline = now + options_.timeout;
+    fds.clear();
+    for (const auto& conn : active) {
+      const short events =
+          conn.phase == ConnectionPhase::kReceiving ? POLLIN : POLLOUT;
+      fds.push_back(pollfd{conn.fd, events, 0});
+      earliest_deadline =
+          std::min(earliest_deadline, conn.started + options_.timeout);
+    }
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+        earliest_deadline - now);
+    int ready = poll(fds.data(), fds.size(),
+                     static_cast<int>(std::max<long long>(0, wait.count()) + 1));
+    if (ready < 0 && errno != EINTR) {
+      std::cerr << "Aggregator: poll failed: " << std::strerror(errno)
+                << std::endl;
+      for (auto& conn : active) {
+        finish(&conn, false);
+      }
+      active.clear();
+      continue;
+    }
+
+    now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < active.size(); ++i) {
+      Connection& conn = active[i];
+      if (ready > 0 && fds[i].revents != 0) {
+        ConnectionState state = Advance(&conn, fds[i].revents);
+        if (state != ConnectionState::kPending) {
+          finish(&conn, state == ConnectionState::kDone);
+          continue;
+        }
+      }
+      if (now - conn.started > options_.timeout) {
+        finish(&conn, false);
+      }
+    }
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [](const Connection& conn) {
+                                  return conn.fd < 0;
+                                }),
+                 active.end());
+  }
+
+  return results;
+}
+
+void FormatAggregate(const std::vector<AgentScrapeResult>& results,
+                     MetricsSnapshot* snapshot) {
+  if (!snapshot) {
+    return;
+  }
+  snapshot->text.clear();
+  snapshot->families.clear();
+
+  FamilyMerger merger;
+  std::vector<double> health_scores;
+  double gpu_memory_used_bytes = 0.0;
+  double gpu_memory_total_bytes = 0.0;
+  size_t nodes_up = 0;
+
+  for (const auto& result : results) {
+    if (!result.up) {
+      continue;
+    }
+    ++nodes_up;
+    std::string node_label;
+    AppendNodeLabel(&node_label, result.target);
+    size_t line_start = 0;
+    while (line_start < result.body.size()) {
+      size_t line_end = result.body.find('\n', line_start);
+      if (line_end == std::string::npos) {
+        line_end = result.body.size();
+      }
+      const std::string line =
+          result.body.substr(line_start, line_end - line_start);
+      line_start = line_end + 1;
+      if (line.empty() || line[0] == '#') {
+        continue;
+      }
+      const size_t name_end = line.find_first_of("{ ");
+      double value = 0.0;
+      if (name_end == std::string::npos ||
+          !ParseSampleValue(line, name_end, &value)) {
+        continue;
+      }
+      const std::string name = line.substr(0, name_end);
+
+      std::string* out = merger.Family(name);
+      out->append(name);
+      out->append(node_label);
+      size_t rest = name_end;
+      if (line[name_end] == '{') {
+        rest = AppendUpstreamLabels(line, name_end, out);
+      } else {
+        out->push_back('}');
+      }
+      out->append(line, rest, std::string::npos);
+      out->push_back('\n');
+
+      if (name == "node_health_score") {
+        health_scores.push_back(value);
+      } else if (name == "gpu_memory_used_bytes") {
+        gpu_memory_used_bytes += value;
+      } else if (name == "gpu_memory_total_bytes") {
+        gpu_memory_total_bytes += value;
+      }
+    }
+  }
+
+  std::string* up = merger.Family("aggregator_agent_up");
+  std::string* duration = merger.Family("aggregator_agent_scrape_duration_seconds");
+  for (const auto& result : results) {
+    AppendNodeSample(up, "aggregator_agent_up", result.target,
+                     result.up ? 1.0 : 0.0);
+    AppendNodeSample(duration, "aggregator_agent_scrape_duration_seconds",
+                     result.target, result.duration_seconds);
+  }
+
+  AppendClusterSample(merger.Family("cluster_nodes_total"),
+                      "cluster_nodes_total",
+                      static_cast<double>(results.size()));
+  AppendClusterSample(merger.Family("cluster_nodes_up"), "cluster_nodes_up",
+                      static_cast<double>(nodes_up));
+
+  // A summary over the node health scores: quantiles plus _sum and _count.
+  std::sort(health_scores.begin(), health_scores.end());
+  std::string* out = merger.Family("cluster_node_health_score");
+  if (!health_scores.empty()) {
+    for (const Quantile& q : kHealthScoreQuantiles) {
+      out->append("cluster_node_health_score{quantile=\"");
+      out->append(q.label);
+      out->append("\"} ");
+      AppendSampleValue(out, NearestRankQuantile(health_scores, q.value));
+      out->push_back('\n');
+    }
+    double sum = 0.0;
+    for (double score : health_scores) {
+      sum += score;
+    }
+    AppendClusterSample(out, "cluster_node_health_score_sum", sum);
+    AppendClusterSample(out, "cluster_node_health_score_count",
+                        static_cast<double>(health_scores.size()));
+  }
+
+  AppendClusterSample(merger.Family("cluster_gpu_memory_used_bytes"),
+                      "cluster_gpu_memory_used_bytes", gpu_memory_used_bytes);
+  AppendClusterSample(merger.Family("cluster_gpu_memory_total_bytes"),
+                      "cluster_gpu_memory_total_bytes",
+                      gpu_memory_total_bytes);
+
+  merger.Render(snapshot);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+// Collection entry points used by the agent. Internal to the library: they
+// advance the delta state (previous /proc/stat totals, per-process and
+// numastat baselines) behind the published rates, so embedders query
+// snapshots through agent.hpp instead.
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+#include "cpu_metrics.hpp"
+#include "numa_metrics.hpp"
+#include "state_store.hpp"
+
+CpuMetrics CollectCpuMetrics();
+// The top `max_processes` processes by CPU time and, separately, by resident
+// memory.
+CpuTopProcesses CollectTopCpuProcesses(size_t max_processes);
+
+// Per-node memory, allocation locality and CPU topology from
+// /sys/devices/system/node. Empty on non-NUMA-aware platforms.
+std::vector<NumaNodeMetrics> CollectNumaMetrics();
+
+// Counter baselines behind the delta-based metrics, for warm restarts.
+// Restore before the first collection.
+void SaveCpuCounterBaselines(std::vector<CounterBaseline>* baselines);
+void RestoreCpuCounterBaselines(const std::vector<CounterBaseline>& baselines,
+                                std::chrono::system_clock::time_point saved_at);
+void SaveNumaCounterBaselines(std::vector<CounterBaseline>* baselines);
+void RestoreNumaCounterBaselines(
+    const std::vector<CounterBaseline>& baselines,
+    std::chrono::system_clock::time_point saved_at);
@@ -6,7 +6,9 @@
 #include <cstring>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
 
 #ifdef __APPLE__
 #include <libproc.h>
@@ -20,14 +22,148 @@
 #include <unistd.h>
 #endif
 
+#include "collectors.hpp"
+#include "ddsketch.hpp"
+#include "process_sampler.hpp"
 #include "util.hpp"
 
 namespace {
 
-double Clamp(double value, double min_value, double max_value) {
-  return std::min(std::max(value, min_value), max_value);
+// Extended per-process stats of the exported processes: the busiest ones by
+// current CPU rate are re-read every cycle, the rest round-robin, within this per-cycle budget of
+// sampled processes.
+constexpr size_t kExtendedHotProcessCount = 20;
+constexpr size_t kExtendedProcessesPerCycle = 64;
+constexpr std::chrono::milliseconds kExtendedStatsBudget{50};
+
+// Full-population process summaries use fixed-memory sketches.
+constexpr double kSketchRelativeAccuracy = 0.01;
+constexpr size_t kSketchMaxBins = 2048;
+constexpr double kSummaryQuantiles[] = {0.5, 0.9, 0.99};
+
+ProcessDistribution Summarize(const DDSketch& sketch) {
+  ProcessDistribution distribution;
+  distribution.count = sketch.count();
+  distribution.sum = sketch.sum();
+  for (double q : kSummaryQuantiles) {
+    distribution.quantiles.push_back({q, sketch.Quantile(q)});
+  }
+  return distribution;
+}
+
+void CountProcessState(char state, CpuProcessSummary* summary) {
+  switch (state) {
+    case 'R':
+      ++summary->running;
+      break;
+    case 'S':
+      ++summary->sleeping;
+      break;
+    case 'D':
+      ++summary->disk_sleep;
+      break;
+    case 'Z':
+      ++summary->zombie;
+      break;
+    case 'T':
+    case 't':
+      ++summary->stopped;
+      break;
+    case 'I':
+      ++summary->idle;
+      break;
+    default:
+      break;
+  }
 }
 
+// Remembers each process's CPU time between scans to derive CPU rates.
+class ProcessCpuRateTracker {
+ public:
+  void BeginScan() {
+    current_scan_ = std::chrono::steady_clock::now();
+    current_.clear();
+  }
+
+  // Returns the CPU rate since the previous scan, and adds it to `sketch`,
+  // when the same process (pid and start time) was seen then; 0 otherwise.
+  double Observe(int pid, unsigned long long start_time_ticks,
+                 double cpu_time_seconds, DDSketch* sketch) {
+    current_[pid] = {start_time_ticks, cpu_time_seconds};
+    auto it = previous_.find(pid);
+    if (it == previous_.end() ||
+        it->second.start_time_ticks != start_time_ticks) {
+      return 0.0;
+    }
+    const double elapsed =
+        std::chrono::duration<double>(current_scan_ - previous_scan_).count();
+    if (elapsed <= 0.0 || cpu_time_seconds < it->second.cpu_time_seconds) {
+      return 0.0;
+    }
+    const double rate =
+        (cpu_time_seconds - it->second.cpu_time_seconds) / elapsed;
+    sketch->Add(rate);
+    return rate;
+  }
+
+  void EndScan() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    previous_.swap(current_);
+    previous_scan_ = current_scan_;
+  }
+
+  // Safe to call from any thread; the scanning thread only mutates the
+  // previous scan in EndScan().
+  void Save(std::vector<CounterBaseline>* baselines) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [pid, baseline] : previous_) {
+      CounterBaseline record;
+      record.kind = CounterKind::kProcessCpuTime;
+      record.key = static_cast<uint64_t>(pid);
+      record.identity = baseline.start_time_ticks;
+      record.values[0] =
+          static_cast<uint64_t>(baseline.cpu_time_seconds * 1e9);
+      baselines->push_back(record);
+    }
+  }
+
+  // Seeds the previous scan as if it had happened at `saved_at`.
+  void Restore(const std::vector<CounterBaseline>& baselines,
+               std::chrono::system_clock::time_point saved_at) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    previous_.clear();
+    for (const CounterBaseline& record : baselines) {
+      if (record.kind == CounterKind::kProcessCpuTime) {
+        previous_[static_cast<int>(record.key)] = {
+            record.identity, static_cast<double>(record.values[0]) / 1e9};
+      }
+    }
+    const auto age = std::chrono::system_clock::now() - saved_at;
+    previous_scan_ = std::chrono::steady_clock::now() -
+                     std::chrono::duration_cast<
+                         std::chrono::steady_clock::duration>(age);
+  }
+
+ private:
+  struct Baseline {
+    unsigned long long start_time_ticks = 0;
+    double cpu_time_seconds = 0.0;
+  };
+
+  std::unordered_map<int, Baseline> previous_;
+  std::unordered_map<int, Baseline> current_;
+  std::chrono::steady_clock::time_point previous_scan_;
+  std::chrono::steady_clock::time_point current_scan_;
+  mutable std::mutex mutex_;
+};
+
+ProcessCpuRateTracker g_cpu_rate_tracker;
+
+// /proc/stat totals from the previous CollectCpuMetrics() call.
+std::mutex g_cpu_totals_mutex;
+unsigned long long g_prev_cpu_total = 0;
+unsigned long long g_prev_cpu_idle = 0;
+
 double ParsePressureAvg10(const std::string& content) {
   const std::string needle = "avg10=";
   size_t pos = content.find(needle);
@@ -45,21 +181,33 @@ double ParsePressureAvg10(const std::string& content) {
   }
 }
 
-double GetCpuCoreCount() {
-#ifdef __linux__
-  long cores = sysconf(_SC_NPROCESSORS_ONLN);
-  return cores > 0 ? static_cast<double>(cores) : 1.0;
-#elif defined(__APPLE__)
-  uint32_t cores = 0;
-  size_t size = sizeof(cores);
-  if (sysctlbyname("hw.logicalcpu", &cores, &size, nullptr, 0) == 0 &&
-      cores > 0) {
-    return static_cast<double>(cores);
+// Orders `top->processes` by CPU time and keeps the first `max_processes`.
+// The top `max_processes` by resident memory are copied out first, ordered by
+// it, so that both rankings are exact over every scanned process.
+void SelectTopProcesses(size_t max_processes, CpuTopProcesses* top) {
+  std::vector<CpuProcessMetrics>& processes = top->processes;
+  std::vector<const CpuProcessMetrics*> by_rss;
+  by_rss.reserve(processes.size());
+  for (const auto& proc : processes) {
+    by_rss.push_back(&proc);
+  }
+  const size_t rss_count = std::min(max_processes, by_rss.size());
+  std::partial_sort(by_rss.begin(), by_rss.begin() + rss_count, by_rss.end(),
+                    [](const CpuProcessMetrics* a, const CpuProcessMetrics* b) {
+                      return a->rss_bytes > b->rss_bytes;
+                    });
+  top->processes_by_rss.reserve(rss_count);
+  for (size_t i = 0; i < rss_count; ++i) {
+    top->processes_by_rss.push_back(*by_rss[i]);
+  }
+
+  std::sort(processes.begin(), processes.end(),
+            [](const CpuProcessMetrics& a, const CpuProcessMetrics& b) {
+              return a.cpu_time_seconds > b.cpu_time_seconds;
+            });
+  if (processes.size() > max_processes) {
+    processes.resize(max_processes);
   }
-  return 1.0;
-#else
-  return 1.0;
-#endif
 }
 
 }  // namespace
@@ -95,8 +243,9 @@ CpuMetrics CollectCpuMetrics() {
       const unsigned long long non_idle =
           user + nice + system + irq + softirq + steal;
       const unsigned long long total = idle_all + non_idle;
-      static unsigned long long prev_total = 0;
-      static unsigned long long prev_idle = 0;
+      std::lock_guard<std::mutex> lock(g_cpu_totals_mutex);
+      const unsigned long long prev_total = g_prev_cpu_total;
+      const unsigned long long prev_idle = g_prev_cpu_idle;
       if (prev_total != 0 && total > prev_total && idle_all >= prev_idle) {
         const unsigned long long total_delta = total - prev_total;
         const unsigned long long idle_delta = idle_all - prev_idle;
@@ -106,14 +255,15 @@ CpuMetrics CollectCpuMetrics() {
               static_cast<double>(total_delta);
         }
       }
-      prev_total = total;
-      prev_idle = idle_all;
+      g_prev_cpu_total = total;
+      g_prev_cpu_idle = idle_all;
     }
   }
 
   metrics.cpu_pressure_avg10 = ParsePressureAvg10(ReadFile("/proc/pressure/cpu"));
   metrics.memory_pressure_avg10 =
       ParsePressureAvg10(ReadFile("/proc/pressure/memory"));
+  metrics.io_pressure_avg10 = ParsePressureAvg10(ReadFile("/proc/pressure/io"));
 
   std::string meminfo = ReadFile("/proc/meminfo");
   if (!meminfo.empty()) {
@@ -176,25 +326,24 @@ CpuTopProcesses CollectTopCpuProcesses(size_t max_processes) {
   CpuTopProcesses result;
 
 #ifdef __linux__
-  const auto deadline =
-      std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
-  const auto time_exhausted = [&deadline]() {
-    return std::chrono::steady_clock::now() > deadline;
-  };
-
+  // The stat pass has no deadline of its own: the summaries and the rate
+  // baselines must cover every process, and the supervising collector's
+  // timeout already bounds how long a slow scan can hold up a refresh.
   DIR* proc_dir = opendir("/proc");
   if (!proc_dir) {
     std::cerr << "Failed to open /proc: " << std::strerror(errno) << std::endl;
     return result;
   }
 
+  DDSketch cpu_rate_sketch(kSketchRelativeAccuracy, kSketchMaxBins);
+  DDSketch rss_sketch(kSketchRelativeAccuracy, kSketchMaxBins);
+  CpuProcessSummary& summary = result.summary;
+  g_cpu_rate_tracker.BeginScan();
+
   const long page_size = sysconf(_SC_PAGESIZE);
   const long ticks_per_second = sysconf(_SC_CLK_TCK);
   struct dirent* entry = nullptr;
   while ((entry = readdir(proc_dir)) != nullptr) {
-    if (time_exhausted()) {
-      break;
-    }
     if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN) {
       continue;
     }
@@ -240,6 +389,7 @@ CpuTopProcesses CollectTopCpuProcesses(size_t max_processes) {
     unsigned long long utime = std::strtoull(tokens[11].c_str(), nullptr, 10);
     unsigned long long stime = std::strtoull(tokens[12].c_str(), nullptr, 10);
     long rss_pages = std::strtol(tokens[21].c_str(), nullptr, 10);
+    proc.start_time_ticks = std::strtoull(tokens[19].c_str(), nullptr, 10);
 
     const unsigned long long total_ticks = utime + stime;
     if (ticks_per_second > 0) {
@@ -251,28 +401,30 @@ CpuTopProcesses CollectTopCpuProcesses(size_t max_processes) {
                             static_cast<unsigned long long>(page_size)
                       : 0;
 
+    ++summary.process_count;
+    summary.thread_count += std::strtoull(tokens[17].c_str(), nullptr, 10);
+    CountProcessState(tokens[0][0], &summary);
+    rss_sketch.Add(static_cast<double>(proc.rss_bytes));
+    proc.cpu_rate_cores = g_cpu_rate_tracker.Observe(
+        pid, proc.start_time_ticks, proc.cpu_time_seconds, &cpu_rate_sketch);
+
     result.processes.push_back(std::move(proc));
   }
 
   closedir(proc_dir);
+  g_cpu_rate_tracker.EndScan();
+  summary.cpu_rate_cores = Summarize(cpu_rate_sketch);
+  summary.rss_bytes = Summarize(rss_sketch);
 
-  std::sort(result.processes.begin(), result.processes.end(),
-            [](const CpuProcessMetrics& a, const CpuProcessMetrics& b) {
-              return a.cpu_time_seconds > b.cpu_time_seconds;
-            });
+  SelectTopProcesses(max_processes, &result);
 
-  if (result.processes.size() > max_processes) {
-    result.processes.resize(max_processes);
-  }
+  static ExtendedStatsSampler extended_sampler(kExtendedHotProcessCount,
+                                               kExtendedProcessesPerCycle,
+                                               kExtendedStatsBudget);
+  extended_sampler.Sample(&result.processes);
 
   return result;
 #elif defined(__APPLE__)
-  const auto deadline =
-      std::chrono::steady_clock::now() + std::chrono::milliseconds(200);
-  const auto time_exhausted = [&deadline]() {
-    return std::chrono::steady_clock::now() > deadline;
-  };
-
   int buffer_size = proc_listpids(PROC_ALL_PIDS, 0, nullptr, 0);
   if (buffer_size <= 0) {
     std::cerr << "Failed to list processes via proc_listpids" << std::endl;
@@ -287,10 +439,12 @@ CpuTopProcesses CollectTopCpuProcesses(size_t max_processes) {
     return result;
   }
 
+  DDSketch cpu_rate_sketch(kSketchRelativeAccuracy, kSketchMaxBins);
+  DDSketch rss_sketch(kSketchRelativeAccuracy, kSketchMaxBins);
+  CpuProcessSummary& summary = result.summary;
+  g_cpu_rate_tracker.BeginScan();
+
   for (pid_t pid : pids) {
-    if (time_exhausted()) {
-      break;
-    }
     if (pid <= 0) {
       continue;
     }
@@ -315,17 +469,21 @@ CpuTopProcesses CollectTopCpuProcesses(size_t max_processes) {
         taskinfo.pti_total_user + taskinfo.pti_total_system;
     proc.cpu_time_seconds = static_cast<double>(total_ns) / 1e9;
 
+    ++summary.process_count;
+    summary.thread_count += static_cast<unsigned long long>(
+        std::max(taskinfo.pti_threadnum, 0));
+    rss_sketch.Add(static_cast<double>(proc.rss_bytes));
+    proc.cpu_rate_cores = g_cpu_rate_tracker.Observe(
+        proc.pid, 0, proc.cpu_time_seconds, &cpu_rate_sketch);
+
     result.processes.push_back(std::move(proc));
   }
 
-  std::sort(result.processes.begin(), result.processes.end(),
-            [](const CpuProcessMetrics& a, const CpuProcessMetrics& b) {
-              return a.cpu_time_seconds > b.cpu_time_seconds;
-            });
+  g_cpu_rate_tracker.EndScan();
+  summary.cpu_rate_cores = Summarize(cpu_rate_sketch);
+  summary.rss_bytes = Summarize(rss_sketch);
 
-  if (result.processes.size() > max_processes) {
-    result.processes.resize(max_processes);
-  }
+  SelectTopProcesses(max_processes, &result);
 
   return result;
 #else
@@ -334,54 +492,30 @@ CpuTopProcesses CollectTopCpuProcesses(size_t max_processes) {
 #endif
 }
 
-double GetCpuLoad1m() {
-  return CollectCpuMetrics().load_1m;
-}
-
-unsigned long long GetNodeMemoryTotalBytes() {
-  return CollectCpuMetrics().mem_total_bytes;
-}
-
-unsigned long long GetNodeMemoryAvailableBytes() {
-  return CollectCpuMetrics().mem_available_bytes;
-}
-
-CpuTopProcesses GetCpuProcessCpuSecondsTotal(size_t max_processes) {
-  return CollectTopCpuProcesses(max_processes);
-}
-
-CpuTopProcesses GetCpuProcessRssBytes(size_t max_processes) {
-  return CollectTopCpuProcesses(max_processes);
-}
-
-double ComputeNodeHealthScore(const CpuMetrics& metrics) {
-  double cpu_util_score = Clamp(1.0 - metrics.cpu_utilization, 0.0, 1.0);
-
-  const double cores = GetCpuCoreCount();
-  const double cpu_load_score =
-      Clamp(1.0 - (metrics.load_1m / cores), 0.0, 1.0);
-
-  double mem_score = 0.0;
-  if (metrics.mem_total_bytes > 0) {
-    mem_score = static_cast<double>(metrics.mem_available_bytes) /
-                static_cast<double>(metrics.mem_total_bytes);
+void SaveCpuCounterBaselines(std::vector<CounterBaseline>* baselines) {
+  {
+    std::lock_guard<std::mutex> lock(g_cpu_totals_mutex);
+    if (g_prev_cpu_total != 0) {
+      CounterBaseline record;
+      record.kind = CounterKind::kCpuTotals;
+      record.values[0] = g_prev_cpu_total;
+      record.values[1] = g_prev_cpu_idle;
+      baselines->push_back(record);
+    }
   }
-  mem_score = Clamp(mem_score, 0.0, 1.0);
-
-  const double cpu_pressure_penalty =
-      Clamp(metrics.cpu_pressure_avg10 / 100.0, 0.0, 1.0);
-  const double memory_pressure_penalty =
-      Clamp(metrics.memory_pressure_avg10 / 100.0, 0.0, 1.0);
-
-  const double cpu_score =
-      0.6 * cpu_util_score + 0.4 * cpu_load_score;
-  const double weighted =
-      0.5 * cpu_score + 0.3 * mem_score +
-      0.1 * (1.0 - cpu_pressure_penalty) +
-      0.1 * (1.0 - memory_pressure_penalty);
-  return Clamp(weighted, 0.0, 1.0) * 10.0;
+  g_cpu_rate_tracker.Save(baselines);
 }
 
-double GetNodeHealthScore() {
-  return ComputeNodeHealthScore(CollectCpuMetrics());
+void RestoreCpuCounterBaselines(const std::vector<CounterBaseline>& baselines,
+                                std::chrono::system_clock::time_point saved_at) {
+  {
+    std::lock_guard<std::mutex> lock(g_cpu_totals_mutex);
+    for (const CounterBaseline& record : baselines) {
+      if (record.kind == CounterKind::kCpuTotals) {
+        g_prev_cpu_total = record.values[0];
+        g_prev_cpu_idle = record.values[1];
+      }
+    }
+  }
+  g_cpu_rate_tracker.Restore(baselines, saved_at);
 }
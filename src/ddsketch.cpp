@@ -0,0 +1,93 @@
+#include "ddsketch.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Values below this are counted as zero rather than given their own bucket.
+constexpr double kMinIndexableValue = 1e-9;
+
+}  // namespace
+
+DDSketch::DDSketch(double relative_accuracy, size_t max_bins)
+    : gamma_((1.0 + relative_accuracy) / (1.0 - relative_accuracy)),
+      log_gamma_(std::log(gamma_)),
+      max_bins_(std::max<size_t>(1, max_bins)) {
+  bins_.reserve(max_bins_);
+}
+
+int DDSketch::Index(double value) const {
+  return static_cast<int>(std::ceil(std::log(value) / log_gamma_));
+}
+
+double DDSketch::Value(int index) const {
+  // Midpoint of the bucket (gamma^(i-1), gamma^i] in relative terms.
+  return 2.0 * std::pow(gamma_, index) / (gamma_ + 1.0);
+}
+
+void DDSketch::Add(double value) {
+  if (!(value >= 0.0)) {
+    return;
+  }
+  ++count_;
+  sum_ += value;
+  if (value < kMinIndexableValue) {
+    ++zero_count_;
+    return;
+  }
+
+  int index = Index(value);
+  if (bins_.empty()) {
+    min_index_ = index;
+    bins_.push_back(0);
+  } else if (index < min_index_) {
+    const size_t grow = static_cast<size_t>(min_index_ - index);
+    if (bins_.size() + grow <= max_bins_) {
+      bins_.insert(bins_.begin(), grow, 0);
+      min_index_ = index;
+    } else {
+      // Out of room below: fold into the lowest bucket.
+      index = min_index_;
+    }
+  } else if (static_cast<size_t>(index - min_index_) >= bins_.size()) {
+    const size_t needed = static_cast<size_t>(index - min_index_) + 1;
+    if (needed > max_bins_) {
+      // Collapse the lowest buckets to make room at the top.
+      const size_t collapse = needed - max_bins_;
+      uint64_t folded = 0;
+      for (size_t i = 0; i < collapse && i < bins_.size(); ++i) {
+        folded += bins_[i];
+      }
+      bins_.erase(bins_.begin(),
+                  bins_.begin() + static_cast<std::ptrdiff_t>(
+                                      std::min(collapse, bins_.size())));
+      min_index_ += static_cast<int>(collapse);
+      if (bins_.empty()) {
+        bins_.push_back(0);
+      }
+      bins_[0] += folded;
+    }
+    bins_.resize(static_cast<size_t>(index - min_index_) + 1, 0);
+  }
+  ++bins_[static_cast<size_t>(index - min_index_)];
+}
+
+double DDSketch::Quantile(double q) const {
+  if (count_ == 0) {
+    return 0.0;
+  }
+  q = std::min(std::max(q, 0.0), 1.0);
+  const uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count_ - 1));
+  if (rank < zero_count_) {
+    return 0.0;
+  }
+  uint64_t seen = zero_count_;
+  for (size_t i = 0; i < bins_.size(); ++i) {
+    seen += bins_[i];
+    if (seen > rank) {
+      return Value(min_index_ + static_cast<int>(i));
+    }
+  }
+  return Value(min_index_ + static_cast<int>(bins_.size()) - 1);
+}
@@ -1,8 +1,16 @@
 #include "gpu_metrics.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
+#include "numa_metrics.hpp"
 #include "util.hpp"
 
 #ifdef USE_NVML
@@ -11,6 +19,189 @@
 
 namespace {
 
+#ifdef USE_NVML
+constexpr std::chrono::seconds kInitialInitBackoff{1};
+constexpr std::chrono::seconds kMaxInitBackoff{60};
+// Bounds how long shutdown or a lost GPU waits on a blocked event wait.
+constexpr unsigned int kXidWaitTimeoutMs = 500;
+// Critical XIDs after which the driver state of the GPU cannot be trusted
+// (double-bit/uncontained ECC, row-remap failure, micro-controller halt,
+// NVLink error, fallen off the bus, GSP errors). Others are only logged.
+constexpr unsigned long long kRecoveryXids[] = {48, 62, 64, 74,
+                                                79, 95, 119, 120};
+
+// Guards the lifecycle state below.
+std::mutex g_gpu_mutex;
+std::condition_variable g_gpu_cv;
+GpuSubsystemState g_gpu_state = GpuSubsystemState::kInitializing;
+unsigned long long g_init_attempts = 0;
+unsigned long long g_reinitializations = 0;
+bool g_gpu_shutdown = false;
+std::thread g_gpu_lifecycle;
+// Serializes NVML calls so that collection never races a re-initialization.
+std::mutex g_nvml_mutex;
+
+// Converts an NVML bus id ("00000000:3B:00.1") to the sysfs form
+// ("0000:3b:00.1"): lower case, with the domain trimmed to 4 digits unless
+// it needs more. The function number is kept as reported.
+std::string NormalizePciBusId(const char* nvml_bus_id) {
+  std::string bus_id = nvml_bus_id;
+  std::transform(bus_id.begin(), bus_id.end(), bus_id.begin(), [](char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  });
+  const size_t colon = bus_id.find(':');
+  if (colon == std::string::npos ||
+      bus_id.find(':', colon + 1) == std::string::npos) {
+    return bus_id;  // No domain: already "bus:device.function".
+  }
+  size_t strip = 0;
+  while (colon - strip > 4 && bus_id[strip] == '0') {
+    ++strip;
+  }
+  return bus_id.substr(strip);
+}
+
+// Asks the lifecycle thread to re-initialize NVML; no-op unless ready.
+void ScheduleReinitialization() {
+  {
+    std::lock_guard<std::mutex> lock(g_gpu_mutex);
+    if (g_gpu_state != GpuSubsystemState::kReady) {
+      return;
+    }
+    g_gpu_state = GpuSubsystemState::kLost;
+  }
+  g_gpu_cv.notify_all();
+}
+
+void MarkGpuLost(const char* context, nvmlReturn_t nvml_result) {
+  std::cerr << "NVML: " << context << ": " << nvmlErrorString(nvml_result)
+            << "; scheduling re-initialization" << std::endl;
+  ScheduleReinitialization();
+}
+
+bool IsRecoveryXid(unsigned long long xid) {
+  return std::find(std::begin(kRecoveryXids), std::end(kRecoveryXids), xid) !=
+         std::end(kRecoveryXids);
+}
+
+bool GpuWatchActive() {
+  std::lock_guard<std::mutex> lock(g_gpu_mutex);
+  return !g_gpu_shutdown && g_gpu_state == GpuSubsystemState::kReady;
+}
+
+// Watches every device for critical XID errors while NVML is ready, so that
+// a GPU whose calls still succeed is re-initialized after a fatal XID rather
+// than only on NVML_ERROR_GPU_IS_LOST. Returns on shutdown, once the GPU is
+// marked lost, or at once when no device supports the events.
+void WatchXidEvents() {
+  nvmlEventSet_t event_set;
+  unsigned int watched = 0;
+  {
+    std::lock_guard<std::mutex> nvml_lock(g_nvml_mutex);
+    nvmlReturn_t nvml_result = nvmlEventSetCreate(&event_set);
+    if (nvml_result != NVML_SUCCESS) {
+      std::cerr << "NVML: XID events unavailable: "
+                << nvmlErrorString(nvml_result) << std::endl;
+      return;
+    }
+    unsigned int device_count = 0;
+    if (nvmlDeviceGetCount_v2(&device_count) != NVML_SUCCESS) {
+      device_count = 0;
+    }
+    for (unsigned int i = 0; i < device_count; ++i) {
+      nvmlDevice_t device;
+      if (nvmlDeviceGetHandleByIndex_v2(i, &device) == NVML_SUCCESS &&
+          nvmlDeviceRegisterEvents(device, nvmlEventTypeXidCriticalError,
+                                   event_set) == NVML_SUCCESS) {
+        ++watched;
+      }
+    }
+  }
+
+  while (watched > 0 && GpuWatchActive()) {
+    nvmlEventData_t event{};
+    const nvmlReturn_t nvml_result =
+        nvmlEventSetWait_v2(event_set, &event, kXidWaitTimeoutMs);
+    if (nvml_result == NVML_ERROR_TIMEOUT) {
+      continue;
+    }
+    if (nvml_result == NVML_ERROR_GPU_IS_LOST) {
+      MarkGpuLost("XID event wait", nvml_result);
+      break;
+    }
+    if (nvml_result != NVML_SUCCESS) {
+      std::cerr << "NVML: XID event wait failed: "
+                << nvmlErrorString(nvml_result) << "; no longer watching"
+                << std::endl;
+      break;
+    }
+    const unsigned long long xid = event.eventData;
+    if (!IsRecoveryXid(xid)) {
+      std::cerr << "NVML: XID " << xid << " reported" << std::endl;
+      continue;
+    }
+    std::cerr << "NVML: critical XID " << xid
+              << "; scheduling re-initialization" << std::endl;
+    ScheduleReinitialization();
+    break;
+  }
+
+  std::lock_guard<std::mutex> nvml_lock(g_nvml_mutex);
+  nvmlEventSetFree(event_set);
+}
+
+// Runs until ShutdownGpuSubsystem(): initializes NVML with exponential
+// backoff, then watches for critical XIDs and sleeps until a lost GPU asks
+// for a re-initialization.
+void GpuLifecycleLoop() {
+  auto backoff = std::chrono::duration_cast<std::chrono::milliseconds>(
+      kInitialInitBackoff);
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(g_gpu_mutex);
+      g_gpu_cv.wait(lock, [] {
+        return g_gpu_shutdown || g_gpu_state != GpuSubsystemState::kReady;
+      });
+      if (g_gpu_shutdown) {
+        return;
+      }
+      if (g_gpu_state == GpuSubsystemState::kLost) {
+        ++g_reinitializations;
+      }
+      ++g_init_attempts;
+    }
+
+    nvmlReturn_t nvml_result;
+    {
+      std::lock_guard<std::mutex> nvml_lock(g_nvml_mutex);
+      // After a lost GPU the old NVML session must be torn down first; this
+      // is a harmless no-op error on a first attempt.
+      nvmlShutdown();
+      nvml_result = nvmlInit_v2();
+    }
+
+    std::unique_lock<std::mutex> lock(g_gpu_mutex);
+    if (nvml_result == NVML_SUCCESS) {
+      g_gpu_state = GpuSubsystemState::kReady;
+      backoff = std::chrono::duration_cast<std::chrono::milliseconds>(
+          kInitialInitBackoff);
+      std::cout << "NVML initialized" << std::endl;
+      lock.unlock();
+      WatchXidEvents();
+      continue;
+    }
+
+    g_gpu_state = GpuSubsystemState::kInitializing;
+    std::cerr << "NVML init failed: " << nvmlErrorString(nvml_result)
+              << "; retrying in " << backoff.count() << "ms" << std::endl;
+    g_gpu_cv.wait_for(lock, backoff, [] { return g_gpu_shutdown; });
+    backoff = std::min(backoff * 2,
+                       std::chrono::duration_cast<std::chrono::milliseconds>(
+                           kMaxInitBackoff));
+  }
+}
+#endif
+
 std::string ExtractContainerIdFromCgroup(const std::string& cgroup_contents) {
   // TODO: Implement robust parsing for cgroup v1/v2 to map to pod/container IDs.
   // As a simple placeholder, return the last path segment that looks non-empty.
@@ -38,15 +229,17 @@ std::string ExtractContainerIdFromCgroup(const std::string& cgroup_contents) {
 
 }  // namespace
 
-void InitializeGpuSubsystem() {
+void StartGpuSubsystem() {
 #ifdef USE_NVML
-  nvmlReturn_t nvml_result = nvmlInit_v2();
-  if (nvml_result != NVML_SUCCESS) {
-    std::cerr << "NVML init failed: " << nvmlErrorString(nvml_result)
-              << std::endl;
-    std::exit(1);
+  if (g_gpu_lifecycle.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_gpu_mutex);
+    g_gpu_shutdown = false;
+    g_gpu_state = GpuSubsystemState::kInitializing;
   }
-  std::cout << "NVML initialized" << std::endl;
+  g_gpu_lifecycle = std::thread(GpuLifecycleLoop);
 #else
   std::cout << "NVML disabled; running in CPU-only mode" << std::endl;
 #endif
@@ -54,6 +247,23 @@ void InitializeGpuSubsystem() {
 
 void ShutdownGpuSubsystem() {
 #ifdef USE_NVML
+  if (!g_gpu_lifecycle.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(g_gpu_mutex);
+    g_gpu_shutdown = true;
+  }
+  g_gpu_cv.notify_all();
+  g_gpu_lifecycle.join();
+  {
+    std::lock_guard<std::mutex> lock(g_gpu_mutex);
+    if (g_gpu_state != GpuSubsystemState::kReady) {
+      return;
+    }
+    g_gpu_state = GpuSubsystemState::kInitializing;
+  }
+  std::lock_guard<std::mutex> nvml_lock(g_nvml_mutex);
   nvmlReturn_t nvml_result = nvmlShutdown();
   if (nvml_result != NVML_SUCCESS) {
     std::cerr << "NVML shutdown failed: " << nvmlErrorString(nvml_result)
@@ -62,6 +272,23 @@ void ShutdownGpuSubsystem() {
 #endif
 }
 
+GpuSubsystemStatus GetGpuSubsystemStatus() {
+  GpuSubsystemStatus status;
+#ifdef USE_NVML
+  std::lock_guard<std::mutex> lock(g_gpu_mutex);
+  status.state = g_gpu_state;
+  status.init_attempts = g_init_attempts;
+  status.reinitializations = g_reinitializations;
+#endif
+  return status;
+}
+
+bool IsGpuSubsystemReady() {
+  const GpuSubsystemState state = GetGpuSubsystemStatus().state;
+  return state == GpuSubsystemState::kReady ||
+         state == GpuSubsystemState::kDisabled;
+}
+
 std::vector<GpuMetrics> CollectGpuMetrics() {
   std::vector<GpuMetrics> result;
 
@@ -70,8 +297,26 @@ std::vector<GpuMetrics> CollectGpuMetrics() {
             << std::endl;
   return result;
 #else
+  if (GetGpuSubsystemStatus().state != GpuSubsystemState::kReady) {
+    return result;
+  }
+  std::lock_guard<std::mutex> nvml_lock(g_nvml_mutex);
+  // A lost GPU invalidates every handle, so drop the whole sample.
+  const auto gpu_lost = [&result](const char* context,
+                                  nvmlReturn_t nvml_result) {
+    if (nvml_result != NVML_ERROR_GPU_IS_LOST) {
+      return false;
+    }
+    MarkGpuLost(context, nvml_result);
+    result.clear();
+    return true;
+  };
+
   unsigned int device_count = 0;
   nvmlReturn_t nvml_result = nvmlDeviceGetCount_v2(&device_count);
+  if (gpu_lost("device count", nvml_result)) {
+    return result;
+  }
   if (nvml_result != NVML_SUCCESS) {
     std::cerr << "NVML: failed to get device count: "
               << nvmlErrorString(nvml_result) << std::endl;
@@ -81,6 +326,9 @@ std::vector<GpuMetrics> CollectGpuMetrics() {
   for (unsigned int i = 0; i < device_count; ++i) {
     nvmlDevice_t device;
     nvml_result = nvmlDeviceGetHandleByIndex_v2(i, &device);
+    if (gpu_lost("device handle", nvml_result)) {
+      return result;
+    }
     if (nvml_result != NVML_SUCCESS) {
       std::cerr << "NVML: failed to get device handle for index " << i << ": "
                 << nvmlErrorString(nvml_result) << std::endl;
@@ -92,12 +340,18 @@ std::vector<GpuMetrics> CollectGpuMetrics() {
 
     nvmlUtilization_t utilization{};
     nvml_result = nvmlDeviceGetUtilizationRates(device, &utilization);
+    if (gpu_lost("utilization", nvml_result)) {
+      return result;
+    }
     if (nvml_result == NVML_SUCCESS) {
       metrics.utilization_gpu_percent = utilization.gpu;
     }
 
     nvmlMemory_t memory{};
     nvml_result = nvmlDeviceGetMemoryInfo(device, &memory);
+    if (gpu_lost("memory info", nvml_result)) {
+      return result;
+    }
     if (nvml_result == NVML_SUCCESS) {
       metrics.memory_used_bytes = memory.used;
       metrics.memory_total_bytes = memory.total;
@@ -105,20 +359,39 @@ std::vector<GpuMetrics> CollectGpuMetrics() {
 
     unsigned int temp = 0;
     nvml_result = nvmlDeviceGetTemperature(device, NVML_TEMPERATURE_GPU, &temp);
+    if (gpu_lost("temperature", nvml_result)) {
+      return result;
+    }
     if (nvml_result == NVML_SUCCESS) {
       metrics.temperature_c = temp;
     }
 
     unsigned int power_mw = 0;
     nvml_result = nvmlDeviceGetPowerUsage(device, &power_mw);
+    if (gpu_lost("power usage", nvml_result)) {
+      return result;
+    }
     if (nvml_result == NVML_SUCCESS) {
       metrics.power_available = true;
       metrics.power_watts = static_cast<double>(power_mw) / 1000.0;
     }
 
+    nvmlPciInfo_t pci{};
+    nvml_result = nvmlDeviceGetPciInfo_v3(device, &pci);
+    if (gpu_lost("pci info", nvml_result)) {
+      return result;
+    }
+    if (nvml_result == NVML_SUCCESS) {
+      metrics.pci_bus_id = NormalizePciBusId(pci.busId);
+      metrics.numa_node = GetPciDeviceNumaNode(metrics.pci_bus_id);
+    }
+
     unsigned int process_count = 0;
     nvml_result =
         nvmlDeviceGetComputeRunningProcesses_v2(device, &process_count, nullptr);
+    if (gpu_lost("process count", nvml_result)) {
+      return result;
+    }
     if (nvml_result == NVML_SUCCESS && process_count == 0) {
       result.push_back(metrics);
       continue;
@@ -135,6 +408,9 @@ std::vector<GpuMetrics> CollectGpuMetrics() {
     std::vector<nvmlProcessInfo_t> processes(process_count);
     nvml_result = nvmlDeviceGetComputeRunningProcesses_v2(
         device, &process_count, processes.data());
+    if (gpu_lost("process list", nvml_result)) {
+      return result;
+    }
     if (nvml_result != NVML_SUCCESS) {
       std::cerr << "NVML: failed to get process list for GPU " << i << ": "
                 << nvmlErrorString(nvml_result) << std::endl;
@@ -0,0 +1,387 @@
+#include "health_score.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+#include "util.hpp"
+
+namespace {
+
+// How often the cgroup and CPU-online files are re-read; they are only
+// re-parsed when their contents changed.
+constexpr std::chrono::seconds kCapacityCheckInterval{10};
+
+constexpr std::pair<const char*, double HealthConfig::*> kWeightKeys[] = {
+    {"cpu_weight", &HealthConfig::cpu_weight},
+    {"memory_weight", &HealthConfig::memory_weight},
+    {"cpu_pressure_weight", &HealthConfig::cpu_pressure_weight},
+    {"memory_pressure_weight", &HealthConfig::memory_pressure_weight},
+};
+
+double Clamp(double value, double min_value, double max_value) {
+  return std::min(std::max(value, min_value), max_value);
+}
+
+std::string Trim(const std::string& value) {
+  const size_t begin = value.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  return value.substr(begin, value.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+double TotalWeight(const HealthConfig& config) {
+  return config.cpu_weight + config.memory_weight +
+         config.cpu_pressure_weight + config.memory_pressure_weight;
+}
+
+#ifdef __linux__
+// Cores granted by a CFS quota, or 0 when unlimited. Accepts cgroup v2
+// cpu.max ("max 100000", "50000 100000") and cgroup v1 quota/period pairs.
+double ParseQuotaCores(const std::string& quota, const std::string& period) {
+  if (quota.empty() || quota == "max" || period.empty()) {
+    return 0.0;
+  }
+  const double quota_us = std::atof(quota.c_str());
+  const double period_us = std::atof(period.c_str());
+  return quota_us > 0 && period_us > 0 ? quota_us / period_us : 0.0;
+}
+#endif
+
+}  // namespace
+
+#ifdef __linux__
+struct HealthScorer::CapacityFiles {
+  explicit CapacityFiles(const std::string& cgroup)
+      : cpu_online("/sys/devices/system/cpu/online"),
+        cpu_max(cgroup + "/cpu.max"),
+        cfs_quota(cgroup + "/cpu.cfs_quota_us"),
+        cfs_period(cgroup + "/cpu.cfs_period_us"),
+        cpuset_effective(cgroup + "/cpuset.cpus.effective"),
+        cpuset_v1_effective(cgroup + "/cpuset.effective_cpus"),
+        cpu_stat(cgroup + "/cpu.stat"),
+        cpuacct_usage(cgroup + "/cpuacct.usage") {}
+
+  // Files missing at startup, or left stale by a recreated cgroup, are
+  // opened again when read.
+  static bool Read(CachedFile* file, std::string* out) {
+    return file->Read(out) || (file->Reopen() && file->Read(out));
+  }
+
+  CachedFile cpu_online;
+  // cgroup v2, with the v1 equivalents as a fallback.
+  CachedFile cpu_max;
+  CachedFile cfs_quota;
+  CachedFile cfs_period;
+  CachedFile cpuset_effective;
+  CachedFile cpuset_v1_effective;
+  // CPU time used by the cgroup: v2 usage_usec, v1 nanoseconds.
+  CachedFile cpu_stat;
+  CachedFile cpuacct_usage;
+};
+#else
+struct HealthScorer::CapacityFiles {};
+#endif
+
+bool LoadHealthConfig(const std::string& path, HealthConfig* config) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Failed to open health config " << path << std::endl;
+    return false;
+  }
+  HealthConfig loaded = *config;
+  std::string line;
+  int line_number = 0;
+  const auto fail = [&path, &line_number](const std::string& message) {
+    std::cerr << "Health config " << path << ":" << line_number << ": "
+              << message << std::endl;
+    return false;
+  };
+  while (std::getline(file, line)) {
+    ++line_number;
+    line = Trim(line.substr(0, line.find('#')));
+    if (line.empty()) {
+      continue;
+    }
+    const size_t eq = line.find('=');
+    if (eq == std::string::npos) {
+      return fail("expected key = value");
+    }
+    const std::string key = Trim(line.substr(0, eq));
+    const std::string value = Trim(line.substr(eq + 1));
+    if (key == "cgroup_path") {
+      loaded.cgroup_path = value;
+      continue;
+    }
+
+    char* end = nullptr;
+    const double number = std::strtod(value.c_str(), &end);
+    if (value.empty() || *end != '\0' || !std::isfinite(number) ||
+        number < 0) {
+      return fail("invalid value for " + key + ": " + value);
+    }
+    bool known = false;
+    for (const auto& [name, field] : kWeightKeys) {
+      if (key == name) {
+        loaded.*field = number;
+        known = true;
+      }
+    }
+    if (key == "cpu_utilization_share") {
+      if (number > 1) {
+        return fail("cpu_utilization_share must be within [0, 1]");
+      }
+      loaded.cpu_utilization_share = number;
+    } else if (key == "half_life_seconds") {
+      loaded.half_life = std::chrono::milliseconds(
+          static_cast<long long>(std::llround(number * 1000)));
+      if (loaded.half_life.count() <= 0) {
+        return fail("half_life_seconds must be positive");
+      }
+    } else if (!known) {
+      return fail("unknown key " + key);
+    }
+  }
+  if (!(TotalWeight(loaded) > 0)) {
+    line_number = 0;
+    return fail("component weights must not all be zero");
+  }
+  *config = std::move(loaded);
+  return true;
+}
+
+HealthScorer::HealthScorer(HealthConfig config)
+    : config_(std::move(config)),
+      capacity_files_(std::make_unique<CapacityFiles>(config_.cgroup_path)) {
+  const HealthConfig defaults;
+  if (!(TotalWeight(config_) > 0)) {
+    for (const auto& [name, field] : kWeightKeys) {
+      config_.*field = defaults.*field;
+    }
+  }
+  if (config_.half_life.count() <= 0) {
+    config_.half_life = defaults.half_life;
+  }
+  total_weight_ = TotalWeight(config_);
+}
+
+HealthScorer::~HealthScorer() = default;
+
+double HealthScorer::CpuCapacity() {
+  const auto now = std::chrono::steady_clock::now();
+  if (capacity_checked_ &&
+      now - last_capacity_check_ < kCapacityCheckInterval) {
+    return capacity_cores_;
+  }
+  capacity_checked_ = true;
+  last_capacity_check_ = now;
+
+#ifdef __linux__
+  CapacityFiles& files = *capacity_files_;
+  std::string online;
+  std::string cpu_max;
+  std::string cfs_quota;
+  std::string cfs_period;
+  std::string cpuset;
+  CapacityFiles::Read(&files.cpu_online, &online);
+  if (!config_.cgroup_path.empty()) {
+    if (CapacityFiles::Read(&files.cpu_max, &cpu_max)) {
+      cpu_max = Trim(cpu_max);
+    } else if (CapacityFiles::Read(&files.cfs_quota, &cfs_quota) &&
+               CapacityFiles::Read(&files.cfs_period, &cfs_period)) {
+      cfs_quota = Trim(cfs_quota);
+      cfs_period = Trim(cfs_period);
+    }
+    if (!CapacityFiles::Read(&files.cpuset_effective, &cpuset)) {
+      CapacityFiles::Read(&files.cpuset_v1_effective, &cpuset);
+    }
+    cpuset = Trim(cpuset);
+  }
+  std::string source = online + '\n' + cpu_max + '\n' + cfs_quota + ' ' +
+                       cfs_period + '\n' + cpuset;
+  if (source == capacity_source_) {
+    return capacity_cores_;
+  }
+  capacity_source_ = std::move(source);
+
+  double cores = static_cast<double>(ParseList(Trim(online)).size());
+  if (cores <= 0) {
+    const long configured = sysconf(_SC_NPROCESSORS_ONLN);
+    cores = configured > 0 ? static_cast<double>(configured) : 1.0;
+  }
+  online_cores_ = cores;
+  const double cpuset_cores = static_cast<double>(ParseList(cpuset).size());
+  if (cpuset_cores > 0) {
+    cores = std::min(cores, cpuset_cores);
+  }
+  const size_t space = cpu_max.find(' ');
+  const double quota_cores =
+      space != std::string::npos
+          ? ParseQuotaCores(cpu_max.substr(0, space), cpu_max.substr(space + 1))
+          : ParseQuotaCores(cfs_quota, cfs_period);
+  if (quota_cores > 0) {
+    cores = std::min(cores, quota_cores);
+  }
+  capacity_cores_ = cores;
+  std::cout << "Health score: CPU capacity " << capacity_cores_ << " cores"
+            << (config_.cgroup_path.empty()
+                    ? std::string()
+                    : " (cgroup " + config_.cgroup_path + ")")
+            << std::endl;
+#elif defined(__APPLE__)
+  uint32_t cores = 0;
+  size_t size = sizeof(cores);
+  if (sysctlbyname("hw.logicalcpu", &cores, &size, nullptr, 0) == 0 &&
+      cores > 0) {
+    capacity_cores_ = static_cast<double>(cores);
+    online_cores_ = capacity_cores_;
+  }
+#endif
+  return capacity_cores_;
+}
+
+bool HealthScorer::ReadCgroupCpuSeconds(double* seconds) {
+#ifdef __linux__
+  if (config_.cgroup_path.empty()) {
+    return false;
+  }
+  CapacityFiles& files = *capacity_files_;
+  std::string content;
+  if (CapacityFiles::Read(&files.cpu_stat, &content)) {
+    const size_t pos = content.find("usage_usec ");
+    if (pos != std::string::npos) {
+      *seconds = std::strtod(content.c_str() + pos + 11, nullptr) / 1e6;
+      return true;
+    }
+  }
+  if (CapacityFiles::Read(&files.cpuacct_usage, &content) &&
+      !content.empty()) {
+    *seconds = std::strtod(content.c_str(), nullptr) / 1e9;
+    return true;
+  }
+#else
+  (void)seconds;
+#endif
+  return false;
+}
+
+bool HealthScorer::LoadRatio(const CpuMetrics& metrics,
+                             std::chrono::steady_clock::time_point now,
+                             double* ratio) {
+  // Node scope: the load average over every online CPU.
+  *ratio = metrics.load_1m / online_cores_;
+  if (config_.cgroup_path.empty()) {
+    return true;
+  }
+  // With a cgroup the load must cover the same scope as its capacity: the
+  // node-wide load average would rate a busy node's small cgroup as
+  // overloaded. Use the cgroup's CPU usage rate over the last interval.
+  double cgroup_seconds = 0.0;
+  if (!ReadCgroupCpuSeconds(&cgroup_seconds)) {
+    return false;
+  }
+  const bool has_rate = has_cgroup_usage_;
+  const double used = cgroup_seconds - prev_cgroup_seconds_;
+  const double elapsed =
+      std::chrono::duration<double>(now - prev_cgroup_usage_at_).count();
+  has_cgroup_usage_ = true;
+  prev_cgroup_seconds_ = cgroup_seconds;
+  prev_cgroup_usage_at_ = now;
+  if (!has_rate || elapsed <= 0 || used < 0) {
+    return false;
+  }
+  *ratio = used / elapsed / capacity_cores_;
+  return true;
+}
+
+HealthComponents HealthScorer::Score(const Inputs& inputs) const {
+  HealthComponents components;
+  const double share = config_.cpu_utilization_share;
+  components.cpu = share * (1.0 - inputs.cpu_utilization) +
+                   (1.0 - share) * Clamp(1.0 - inputs.load_ratio, 0.0, 1.0);
+  components.memory = inputs.memory_available_ratio;
+  components.cpu_pressure = 1.0 - inputs.cpu_pressure;
+  components.memory_pressure = 1.0 - inputs.memory_pressure;
+  return components;
+}
+
+double HealthScorer::Combine(const HealthComponents& components) const {
+  const double weighted =
+      config_.cpu_weight * components.cpu +
+      config_.memory_weight * components.memory +
+      config_.cpu_pressure_weight * components.cpu_pressure +
+      config_.memory_pressure_weight * components.memory_pressure;
+  return Clamp(weighted / total_weight_, 0.0, 1.0) * 10.0;
+}
+
+HealthScore HealthScorer::Update(const CpuMetrics& metrics) {
+  HealthScore score;
+  score.cpu_capacity_cores = CpuCapacity();
+
+  const auto now = std::chrono::steady_clock::now();
+  Inputs sample;
+  sample.cpu_utilization = Clamp(metrics.cpu_utilization, 0.0, 1.0);
+  const bool load_in_scope = LoadRatio(metrics, now, &sample.load_ratio);
+  if (!load_in_scope && has_average_load_) {
+    // No cgroup usage rate this time: carry the cgroup's smoothed load
+    // rather than scoring against the whole node.
+    sample.load_ratio = average_.load_ratio;
+  }
+  if (metrics.mem_total_bytes > 0) {
+    sample.memory_available_ratio =
+        Clamp(static_cast<double>(metrics.mem_available_bytes) /
+                  static_cast<double>(metrics.mem_total_bytes),
+              0.0, 1.0);
+  }
+  sample.cpu_pressure = Clamp(metrics.cpu_pressure_avg10 / 100.0, 0.0, 1.0);
+  sample.memory_pressure =
+      Clamp(metrics.memory_pressure_avg10 / 100.0, 0.0, 1.0);
+
+  // Time-decayed EWMA: a sample `dt` after the previous one gets weight
+  // 1 - 2^(-dt / half_life), so irregular PSI-triggered refreshes count for
+  // as much as the time they cover. The first sample seeds the average.
+  double alpha = 1.0;
+  if (has_average_) {
+    const double elapsed =
+        std::chrono::duration<double>(now - last_update_).count();
+    const double half_life =
+        std::chrono::duration<double>(config_.half_life).count();
+    alpha = 1.0 - std::exp2(-elapsed / half_life);
+  }
+  for (double Inputs::*field :
+       {&Inputs::cpu_utilization, &Inputs::memory_available_ratio,
+        &Inputs::cpu_pressure, &Inputs::memory_pressure}) {
+    average_.*field += alpha * (sample.*field - average_.*field);
+  }
+  // The load average only takes in-scope samples: with a cgroup, the first
+  // sample (which has no usage rate yet) stands in until a rate exists and
+  // is then replaced rather than blended in.
+  if (load_in_scope) {
+    const double load_alpha = has_average_load_ ? alpha : 1.0;
+    average_.load_ratio +=
+        load_alpha * (sample.load_ratio - average_.load_ratio);
+    has_average_load_ = true;
+  } else if (!has_average_load_) {
+    average_.load_ratio = sample.load_ratio;
+  }
+  has_average_ = true;
+  last_update_ = now;
+
+  score.components = Score(sample);
+  score.smoothed_components = Score(average_);
+  score.raw = Combine(score.components);
+  score.smoothed = Combine(score.smoothed_components);
+  return score;
+}
@@ -1,63 +1,260 @@
 #include <arpa/inet.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 #include <cstddef>
+#include <cstdlib>
 #include <chrono>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
-#include "cpu_metrics.hpp"
-#include "gpu_metrics.hpp"
+#include "agent.hpp"
+#include "aggregator.hpp"
 #include "prometheus.hpp"
 
 namespace {
 
 constexpr int kListenPort = 9100;
 constexpr const char* kListenAddr = "0.0.0.0";
-constexpr size_t kTopProcessCount = 100;
 constexpr std::chrono::milliseconds kScrapeInterval{2000};
 
+struct Options {
+  int port = kListenPort;
+  // Non-empty switches the binary into aggregator mode.
+  std::vector<std::string> aggregate_targets;
+  size_t aggregate_parallelism = AggregatorOptions().max_parallel;
+  // Shared-memory snapshot file; empty disables the export. Unless set,
+  // agents on a non-default port get their own file (see ScopeDefaultPaths).
+  std::string shm_path = AgentOptions().shm_path;
+  bool shm_path_set = false;
+  // Counter-baseline checkpoint for warm restarts; empty disables it.
+  std::string state_path = AgentOptions().state_path;
+  bool state_path_set = false;
+  // Health score weights and smoothing, from --health-config.
+  HealthConfig health = AgentOptions().health;
+};
+
+// What the HTTP server serves, published by the agent or the aggregator.
 std::mutex g_metrics_mutex;
-std::string g_metrics_cache;
+std::shared_ptr<const MetricsSnapshot> g_metrics_snapshot =
+    std::make_shared<MetricsSnapshot>();
+// Why /readyz should fail, or nullptr when ready. Points at a literal.
+std::atomic<const char*> g_not_ready_reason{"starting"};
+
+std::shared_ptr<const MetricsSnapshot> CurrentSnapshot() {
+  std::lock_guard<std::mutex> lock(g_metrics_mutex);
+  return g_metrics_snapshot;
+}
+
+void PublishSnapshot(std::shared_ptr<const MetricsSnapshot> snapshot) {
+  std::lock_guard<std::mutex> lock(g_metrics_mutex);
+  g_metrics_snapshot = std::move(snapshot);
+}
+
+// Written by the SIGTERM/SIGINT handler so that the accept loop, whichever
+// thread the signal lands on, wakes up and returns.
+int g_shutdown_pipe[2] = {-1, -1};
 
-void RefreshMetricsLoop() {
-  std::string local_cache;
-  local_cache.reserve(64 * 1024);
+void HandleShutdownSignal(int) {
+  const int saved_errno = errno;
+  const char wake = 1;
+  if (write(g_shutdown_pipe[1], &wake, 1) < 0) {
+    // The pipe is non-blocking; a pending wake-up is enough.
+  }
+  errno = saved_errno;
+}
+
+bool InstallShutdownHandlers() {
+  if (pipe(g_shutdown_pipe) != 0) {
+    std::cerr << "Shutdown pipe error: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+  for (int fd : g_shutdown_pipe) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  }
+  struct sigaction action {};
+  action.sa_handler = HandleShutdownSignal;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGTERM, &action, nullptr);
+  sigaction(SIGINT, &action, nullptr);
+  return true;
+}
+
+// Guards the aggregator refresher's stop request.
+std::mutex g_aggregate_mutex;
+std::condition_variable g_aggregate_cv;
+bool g_aggregate_stop = false;
+
+void RefreshAggregateLoop(std::shared_ptr<AgentScraper> scraper) {
   while (true) {
-    CpuMetrics cpu_metrics = CollectCpuMetrics();
-    CpuTopProcesses cpu_processes = CollectTopCpuProcesses(kTopProcessCount);
-    std::vector<GpuMetrics> gpu_metrics = CollectGpuMetrics();
-    FormatPrometheus(cpu_metrics, cpu_processes, gpu_metrics, &local_cache);
-    {
-      std::lock_guard<std::mutex> lock(g_metrics_mutex);
-      g_metrics_cache.swap(local_cache);
+    const auto next_refresh = std::chrono::steady_clock::now() + kScrapeInterval;
+    std::vector<AgentScrapeResult> results = scraper->ScrapeAll();
+    auto snapshot = std::make_shared<MetricsSnapshot>();
+    snapshot->text.reserve(CurrentSnapshot()->text.size() + 4 * 1024);
+    FormatAggregate(results, snapshot.get());
+    PublishSnapshot(std::move(snapshot));
+
+    bool any_up = false;
+    for (const auto& result : results) {
+      any_up = any_up || result.up;
+    }
+    g_not_ready_reason.store(any_up ? nullptr : "no agents reachable");
+    std::unique_lock<std::mutex> lock(g_aggregate_mutex);
+    if (g_aggregate_cv.wait_until(lock, next_refresh,
+                                  [] { return g_aggregate_stop; })) {
+      return;
     }
-    std::this_thread::sleep_for(kScrapeInterval);
   }
 }
 
-std::string BuildHttpResponse(int status_code, const std::string& body) {
+std::string BuildHttpHeader(int status_code, size_t content_length) {
   std::ostringstream out;
   if (status_code == 200) {
     out << "HTTP/1.1 200 OK\r\n";
+  } else if (status_code == 503) {
+    out << "HTTP/1.1 503 Service Unavailable\r\n";
   } else {
     out << "HTTP/1.1 404 Not Found\r\n";
   }
   out << "Content-Type: text/plain; version=0.0.4\r\n";
-  out << "Content-Length: " << body.size() << "\r\n";
+  out << "Content-Length: " << content_length << "\r\n";
   out << "Connection: close\r\n\r\n";
-  out << body;
   return out.str();
 }
 
-void ServeForever() {
+std::string BuildHttpResponse(int status_code, const std::string& body) {
+  return BuildHttpHeader(status_code, body.size()) + body;
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+std::string UrlDecode(const std::string& value) {
+  std::string out;
+  out.reserve(value.size());
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '%' && i + 2 < value.size() &&
+        HexValue(value[i + 1]) >= 0 && HexValue(value[i + 2]) >= 0) {
+      out.push_back(
+          static_cast<char>(HexValue(value[i + 1]) * 16 + HexValue(value[i + 2])));
+      i += 2;
+    } else if (value[i] == '+') {
+      out.push_back(' ');
+    } else {
+      out.push_back(value[i]);
+    }
+  }
+  return out;
+}
+
+// Extracts `name[]=...` values from the query string of a request line.
+std::vector<std::string> ParseNameFilters(const std::string& request) {
+  std::vector<std::string> names;
+  size_t query_start = request.find('?');
+  size_t line_end = request.find_first_of(" \r\n", request.find(' ') + 1);
+  if (query_start == std::string::npos || query_start > line_end) {
+    return names;
+  }
+  std::string query = request.substr(query_start + 1, line_end - query_start - 1);
+  size_t pos = 0;
+  while (pos <= query.size()) {
+    size_t end = query.find('&', pos);
+    if (end == std::string::npos) {
+      end = query.size();
+    }
+    std::string param = query.substr(pos, end - pos);
+    size_t eq = param.find('=');
+    if (eq != std::string::npos) {
+      std::string key = UrlDecode(param.substr(0, eq));
+      if (key == "name[]") {
+        names.push_back(UrlDecode(param.substr(eq + 1)));
+      }
+    }
+    pos = end + 1;
+  }
+  return names;
+}
+
+// Sends all of `iov`, resuming after partial writes.
+void SendAll(int fd, std::vector<iovec> iov) {
+  size_t index = 0;
+  while (index < iov.size()) {
+    const int count = static_cast<int>(
+        std::min<size_t>(iov.size() - index, static_cast<size_t>(IOV_MAX)));
+    ssize_t written = writev(fd, &iov[index], count);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return;
+    }
+    size_t remaining = static_cast<size_t>(written);
+    while (index < iov.size() && remaining >= iov[index].iov_len) {
+      remaining -= iov[index].iov_len;
+      ++index;
+    }
+    if (remaining > 0) {
+      iov[index].iov_base = static_cast<char*>(iov[index].iov_base) + remaining;
+      iov[index].iov_len -= remaining;
+    }
+  }
+}
+
+// Serves the full exposition, or only the families selected by `name[]`
+// filters, as slices of the published buffer without re-rendering.
+void ServeMetrics(int client_fd, const std::string& request) {
+  std::shared_ptr<const MetricsSnapshot> snapshot = CurrentSnapshot();
+  std::vector<std::string> names = ParseNameFilters(request);
+
+  std::vector<iovec> iov(1);
+  size_t content_length = 0;
+  const auto add_slice = [&](size_t offset, size_t length) {
+    iov.push_back({const_cast<char*>(snapshot->text.data() + offset), length});
+    content_length += length;
+  };
+  if (names.empty()) {
+    add_slice(0, snapshot->text.size());
+  } else {
+    for (const auto& family : SelectMetricFamilies(*snapshot, names)) {
+      add_slice(family.offset, family.length);
+    }
+  }
+
+  std::string header = BuildHttpHeader(200, content_length);
+  iov[0] = {const_cast<char*>(header.data()), header.size()};
+  SendAll(client_fd, std::move(iov));
+}
+
+// Serves HTTP until SIGTERM or SIGINT.
+void Serve(int port) {
   int server_fd = socket(AF_INET, SOCK_STREAM, 0);
   if (server_fd < 0) {
     std::cerr << "Socket error: " << std::strerror(errno) << std::endl;
@@ -69,7 +266,7 @@ void ServeForever() {
 
   sockaddr_in addr{};
   addr.sin_family = AF_INET;
-  addr.sin_port = htons(kListenPort);
+  addr.sin_port = htons(static_cast<uint16_t>(port));
   addr.sin_addr.s_addr = inet_addr(kListenAddr);
 
   if (bind(server_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
@@ -84,15 +281,29 @@ void ServeForever() {
     return;
   }
 
-  std::cout << "Listening on " << kListenAddr << ":" << kListenPort << std::endl;
+  std::cout << "Listening on " << kListenAddr << ":" << port << std::endl;
 
+  pollfd fds[] = {{server_fd, POLLIN, 0}, {g_shutdown_pipe[0], POLLIN, 0}};
   while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno != EINTR) {
+        std::cerr << "Poll error: " << std::strerror(errno) << std::endl;
+      }
+      continue;
+    }
+    if (fds[1].revents != 0) {
+      std::cout << "Shutting down" << std::endl;
+      break;
+    }
+
     sockaddr_in client_addr{};
     socklen_t client_len = sizeof(client_addr);
     int client_fd = accept(server_fd, reinterpret_cast<sockaddr*>(&client_addr),
                            &client_len);
     if (client_fd < 0) {
-      std::cerr << "Accept error: " << std::strerror(errno) << std::endl;
+      if (errno != EINTR) {
+        std::cerr << "Accept error: " << std::strerror(errno) << std::endl;
+      }
       continue;
     }
 
@@ -108,15 +319,24 @@ void ServeForever() {
     bool is_metrics = request.rfind("GET /metrics", 0) == 0;
     bool is_health = request.rfind("GET /healthz", 0) == 0;
     bool is_ready = request.rfind("GET /readyz", 0) == 0;
+    if (is_metrics) {
+      ServeMetrics(client_fd, request);
+      close(client_fd);
+      continue;
+    }
+
     std::string body;
     int status = 200;
-    if (is_metrics) {
-      std::lock_guard<std::mutex> lock(g_metrics_mutex);
-      body = g_metrics_cache;
-    } else if (is_health) {
+    if (is_health) {
       body = "ok\n";
     } else if (is_ready) {
-      body = "ok\n";
+      const char* not_ready_reason = g_not_ready_reason.load();
+      if (!not_ready_reason) {
+        body = "ok\n";
+      } else {
+        status = 503;
+        body = std::string(not_ready_reason) + "\n";
+      }
     } else {
       status = 404;
       body = "not found\n";
@@ -126,23 +346,140 @@ void ServeForever() {
     send(client_fd, response.c_str(), response.size(), 0);
     close(client_fd);
   }
+  close(server_fd);
 }
 
-}  // namespace
+void PrintUsage(const char* argv0) {
+  std::cerr << "Usage: " << argv0 << " [--port=N]"
+            << " [--aggregate=host:port,...] [--aggregate-file=PATH]"
+            << " [--aggregate-parallelism=N] [--shm-path=PATH]"
+            << " [--state-path=PATH] [--health-config=PATH]" << std::endl;
+}
+
+void SplitTargets(const std::string& list, char separator,
+                  std::vector<std::string>* targets) {
+  std::istringstream stream(list);
+  std::string target;
+  while (std::getline(stream, target, separator)) {
+    target.erase(0, target.find_first_not_of(" \t\r"));
+    target.erase(target.find_last_not_of(" \t\r") + 1);
+    if (!target.empty() && target[0] != '#') {
+      targets->push_back(target);
+    }
+  }
+}
+
+bool ParseOptions(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t eq = arg.find('=');
+    const std::string key = arg.substr(0, eq);
+    const std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+    if (key == "--port" && !value.empty()) {
+      options->port = std::atoi(value.c_str());
+    } else if (key == "--aggregate" && !value.empty()) {
+      SplitTargets(value, ',', &options->aggregate_targets);
+    } else if (key == "--aggregate-file" && !value.empty()) {
+      std::ifstream file(value);
+      if (!file.is_open()) {
+        std::cerr << "Failed to open aggregate target file " << value
+                  << std::endl;
+        return false;
+      }
+      std::ostringstream contents;
+      contents << file.rdbuf();
+      SplitTargets(contents.str(), '\n', &options->aggregate_targets);
+    } else if (key == "--aggregate-parallelism" && !value.empty()) {
+      options->aggregate_parallelism =
+          static_cast<size_t>(std::max(1, std::atoi(value.c_str())));
+    } else if (key == "--shm-path" && eq != std::string::npos) {
+      options->shm_path = value;
+      options->shm_path_set = true;
+    } else if (key == "--state-path" && eq != std::string::npos) {
+      options->state_path = value;
+      options->state_path_set = true;
+    } else if (key == "--health-config" && !value.empty()) {
+      if (!LoadHealthConfig(value, &options->health)) {
+        return false;
+      }
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      return false;
+    }
+  }
+  if (options->port <= 0 || options->port > 65535) {
+    std::cerr << "Invalid port: " << options->port << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Several agents may share a host on different ports; give each its own
+// default shared-memory and checkpoint file so they do not overwrite each
+// other's snapshots and baselines.
+void ScopeDefaultPaths(Options* options) {
+  if (options->port == kListenPort) {
+    return;
+  }
+  const std::string suffix = "-" + std::to_string(options->port);
+  if (!options->shm_path_set) {
+    options->shm_path += suffix;
+  }
+  if (!options->state_path_set) {
+    options->state_path += suffix;
+  }
+}
 
-int main() {
-  InitializeGpuSubsystem();
+int RunAggregator(const Options& options) {
+  AggregatorOptions aggregator_options;
+  aggregator_options.targets = options.aggregate_targets;
+  aggregator_options.max_parallel = options.aggregate_parallelism;
+  std::cout << "Aggregating " << aggregator_options.targets.size()
+            << " agents (parallelism " << aggregator_options.max_parallel
+            << ")" << std::endl;
+
+  auto scraper = std::make_shared<AgentScraper>(std::move(aggregator_options));
+  std::thread refresher(RefreshAggregateLoop, scraper);
+  Serve(options.port);
   {
-    CpuMetrics cpu_metrics = CollectCpuMetrics();
-    CpuTopProcesses cpu_processes = CollectTopCpuProcesses(kTopProcessCount);
-    std::vector<GpuMetrics> gpu_metrics = CollectGpuMetrics();
-    std::lock_guard<std::mutex> lock(g_metrics_mutex);
-    FormatPrometheus(cpu_metrics, cpu_processes, gpu_metrics, &g_metrics_cache);
-  }
-  std::thread refresher(RefreshMetricsLoop);
-  refresher.detach();
-  ServeForever();
-  ShutdownGpuSubsystem();
+    std::lock_guard<std::mutex> lock(g_aggregate_mutex);
+    g_aggregate_stop = true;
+  }
+  g_aggregate_cv.notify_all();
+  refresher.join();
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!ParseOptions(argc, argv, &options)) {
+    PrintUsage(argv[0]);
+    return 2;
+  }
+  if (!InstallShutdownHandlers()) {
+    return 1;
+  }
+  if (!options.aggregate_targets.empty()) {
+    return RunAggregator(options);
+  }
+
+  ScopeDefaultPaths(&options);
+  AgentOptions agent_options;
+  agent_options.shm_path = options.shm_path;
+  agent_options.state_path = options.state_path;
+  agent_options.health = options.health;
+  agent_options.on_publish =
+      [](const std::shared_ptr<const AgentSnapshot>& snapshot) {
+        PublishSnapshot(snapshot->exposition);
+        g_not_ready_reason.store(snapshot->not_ready_reason);
+      };
+  StartAgent(agent_options);
+  // On SIGTERM (e.g. a rolling upgrade) the server returns and the agent
+  // checkpoints its counter baselines and releases shm and NVML.
+  Serve(options.port);
+  StopAgent();
 
   return 0;
 }
@@ -0,0 +1,80 @@
+#include "metric_batch.hpp"
+
+MetricBatch::MetricBatch() {
+  Intern("");  // StringId 0: the empty suffix.
+  sample_label_begin_.push_back(0);
+}
+
+MetricBatch::StringId MetricBatch::Intern(std::string_view value) {
+  auto it = string_index_.find(value);
+  if (it != string_index_.end()) {
+    return it->second;
+  }
+  const StringId id = static_cast<StringId>(strings_.size());
+  strings_.emplace_back(value);
+  string_index_.emplace(strings_.back(), id);
+  return id;
+}
+
+MetricBatch::FamilyId MetricBatch::AddFamily(std::string_view name,
+                                             std::string_view help,
+                                             MetricType type) {
+  const StringId name_id = Intern(name);
+  auto it = family_index_.find(name_id);
+  if (it != family_index_.end()) {
+    return it->second;
+  }
+  const FamilyId id = static_cast<FamilyId>(families_.size());
+  families_.push_back({name_id, Intern(help), type});
+  family_index_.emplace(name_id, id);
+  return id;
+}
+
+void MetricBatch::Add(FamilyId family, double value,
+                      std::initializer_list<MetricLabel> labels) {
+  AddSample(family, 0, value, labels);
+}
+
+void MetricBatch::AddSuffixed(FamilyId family, std::string_view suffix,
+                              double value,
+                              std::initializer_list<MetricLabel> labels) {
+  AddSample(family, Intern(suffix), value, labels);
+}
+
+void MetricBatch::AddSample(FamilyId family, StringId suffix, double value,
+                            std::initializer_list<MetricLabel> labels) {
+  for (const MetricLabel& label : labels) {
+    label_names_.push_back(Intern(label.name));
+    label_values_.push_back(Intern(label.value));
+  }
+  sample_family_.push_back(family);
+  sample_suffix_.push_back(suffix);
+  sample_value_.push_back(value);
+  sample_label_begin_.push_back(static_cast<uint32_t>(label_names_.size()));
+}
+
+void MetricBatch::Append(const MetricBatch& other) {
+  std::vector<StringId> string_map(other.strings_.size());
+  for (size_t i = 0; i < other.strings_.size(); ++i) {
+    string_map[i] = Intern(other.strings_[i]);
+  }
+  std::vector<FamilyId> family_map(other.families_.size());
+  for (size_t i = 0; i < other.families_.size(); ++i) {
+    const Family& family = other.families_[i];
+    family_map[i] = AddFamily(other.string(family.name),
+                              other.string(family.help), family.type);
+  }
+
+  for (size_t label = 0; label < other.label_names_.size(); ++label) {
+    label_names_.push_back(string_map[other.label_names_[label]]);
+    label_values_.push_back(string_map[other.label_values_[label]]);
+  }
+  const uint32_t label_offset = sample_label_begin_.back();
+  for (size_t sample = 0; sample < other.sample_count(); ++sample) {
+    sample_family_.push_back(family_map[other.sample_family_[sample]]);
+    sample_suffix_.push_back(string_map[other.sample_suffix_[sample]]);
+    sample_value_.push_back(other.sample_value_[sample]);
+    sample_label_begin_.push_back(label_offset +
+                                  other.sample_label_begin_[sample + 1]);
+  }
+}
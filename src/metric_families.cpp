@@ -0,0 +1,290 @@
+#include "metric_families.hpp"
+
+#include <string>
+
+namespace {
+
+void AddSummary(MetricBatch* batch, MetricBatch::FamilyId family,
+                const ProcessDistribution& distribution) {
+  for (const auto& quantile : distribution.quantiles) {
+    std::string label = std::to_string(quantile.quantile);
+    label.erase(label.find_last_not_of('0') + 1);
+    if (!label.empty() && label.back() == '.') {
+      label.pop_back();
+    }
+    batch->Add(family, quantile.value, {{"quantile", label}});
+  }
+  batch->AddSuffixed(family, "_sum", distribution.sum);
+  batch->AddSuffixed(family, "_count",
+                     static_cast<double>(distribution.count));
+}
+
+}  // namespace
+
+void AppendCpuFamilies(const CpuMetrics& cpu_metrics, MetricBatch* batch) {
+  const auto add_gauge = [batch](const char* name, const char* help,
+                                 double value) {
+    batch->Add(batch->AddFamily(name, help, MetricType::kGauge), value);
+  };
+  add_gauge("cpu_load_1m", "1-minute system load average.",
+            cpu_metrics.load_1m);
+  add_gauge("node_cpu_utilization_ratio", "CPU utilization ratio (0-1).",
+            cpu_metrics.cpu_utilization);
+  add_gauge("node_cpu_pressure_avg10", "CPU pressure avg10 (0-100).",
+            cpu_metrics.cpu_pressure_avg10);
+  add_gauge("node_memory_pressure_avg10", "Memory pressure avg10 (0-100).",
+            cpu_metrics.memory_pressure_avg10);
+  add_gauge("node_io_pressure_avg10", "IO pressure avg10 (0-100).",
+            cpu_metrics.io_pressure_avg10);
+  add_gauge("node_memory_total_bytes", "System memory total in bytes.",
+            static_cast<double>(cpu_metrics.mem_total_bytes));
+  add_gauge("node_memory_available_bytes",
+            "System memory available in bytes.",
+            static_cast<double>(cpu_metrics.mem_available_bytes));
+}
+
+void AppendHealthFamilies(const HealthScore& health, MetricBatch* batch) {
+  const auto add_gauge = [batch](const char* name, const char* help,
+                                 double value) {
+    batch->Add(batch->AddFamily(name, help, MetricType::kGauge), value);
+  };
+  add_gauge("node_health_score", "Overall node health score (0-10).",
+            health.raw);
+  add_gauge("node_health_score_smoothed",
+            "Node health score over time-decayed averages of its inputs "
+            "(0-10).",
+            health.smoothed);
+  add_gauge("node_cpu_capacity_cores",
+            "Effective CPU capacity the load average is normalized by.",
+            health.cpu_capacity_cores);
+
+  const auto component = batch->AddFamily(
+      "node_health_component_score",
+      "Health sub-score per component (0-1, 1 is healthy).",
+      MetricType::kGauge);
+  const auto smoothed_component = batch->AddFamily(
+      "node_health_component_score_smoothed",
+      "Health sub-score per component over smoothed inputs (0-1).",
+      MetricType::kGauge);
+  const std::pair<const char*, double HealthComponents::*> components[] = {
+      {"cpu", &HealthComponents::cpu},
+      {"memory", &HealthComponents::memory},
+      {"cpu_pressure", &HealthComponents::cpu_pressure},
+      {"memory_pressure", &HealthComponents::memory_pressure}};
+  for (const auto& [name, field] : components) {
+    batch->Add(component, health.components.*field, {{"component", name}});
+    batch->Add(smoothed_component, health.smoothed_components.*field,
+               {{"component", name}});
+  }
+}
+
+void AppendNumaFamilies(const std::vector<NumaNodeMetrics>& numa_nodes,
+                        MetricBatch* batch) {
+  const auto mem_total =
+      batch->AddFamily("node_numa_memory_total_bytes",
+                       "NUMA node memory total in bytes.", MetricType::kGauge);
+  const auto mem_free =
+      batch->AddFamily("node_numa_memory_free_bytes",
+                       "NUMA node free memory in bytes.", MetricType::kGauge);
+  const auto cpus = batch->AddFamily(
+      "node_numa_cpus", "CPUs local to the NUMA node.", MetricType::kGauge);
+  const auto miss = batch->AddFamily(
+      "node_numa_miss_pages_per_second",
+      "Pages allocated on this node that were intended for another node.",
+      MetricType::kGauge);
+  const auto foreign = batch->AddFamily(
+      "node_numa_foreign_pages_per_second",
+      "Pages intended for this node that were allocated on another node.",
+      MetricType::kGauge);
+
+  for (const auto& numa : numa_nodes) {
+    const std::string node = std::to_string(numa.node);
+    const std::initializer_list<MetricLabel> labels = {{"numa_node", node}};
+    batch->Add(mem_total, static_cast<double>(numa.mem_total_bytes), labels);
+    batch->Add(mem_free, static_cast<double>(numa.mem_free_bytes), labels);
+    batch->Add(cpus, numa.cpu_count,
+               {{"numa_node", node}, {"cpulist", numa.cpulist}});
+    if (numa.rates_available) {
+      batch->Add(miss, numa.numa_miss_per_second, labels);
+      batch->Add(foreign, numa.numa_foreign_per_second, labels);
+    }
+  }
+}
+
+void AppendProcessFamilies(const CpuTopProcesses& cpu_processes,
+                           MetricBatch* batch) {
+  const auto cpu_seconds =
+      batch->AddFamily("cpu_process_cpu_seconds_total",
+                       "Process CPU time in seconds.", MetricType::kCounter);
+  const auto rss = batch->AddFamily("cpu_process_rss_bytes",
+                                    "Process resident memory in bytes.",
+                                    MetricType::kGauge);
+  const auto io_read = batch->AddFamily(
+      "cpu_process_io_read_bytes_total",
+      "Bytes the process caused to be read from storage.",
+      MetricType::kCounter);
+  const auto io_write = batch->AddFamily(
+      "cpu_process_io_write_bytes_total",
+      "Bytes the process caused to be written to storage.",
+      MetricType::kCounter);
+  const auto voluntary = batch->AddFamily(
+      "cpu_process_voluntary_ctxt_switches_total",
+      "Voluntary context switches.", MetricType::kCounter);
+  const auto nonvoluntary = batch->AddFamily(
+      "cpu_process_nonvoluntary_ctxt_switches_total",
+      "Involuntary context switches.", MetricType::kCounter);
+  const auto open_fds = batch->AddFamily(
+      "cpu_process_open_fds", "Open file descriptors.", MetricType::kGauge);
+  const auto stats_age = batch->AddFamily(
+      "cpu_process_stats_age_seconds",
+      "Age of the sampled extended process stats.", MetricType::kGauge);
+
+  for (const auto& proc : cpu_processes.processes) {
+    const std::string pid = std::to_string(proc.pid);
+    const std::initializer_list<MetricLabel> labels = {{"pid", pid},
+                                                       {"name", proc.name}};
+    batch->Add(cpu_seconds, proc.cpu_time_seconds, labels);
+    batch->Add(rss, static_cast<double>(proc.rss_bytes), labels);
+    if (!proc.extended_available) {
+      continue;
+    }
+    const CpuProcessExtendedStats& extended = proc.extended;
+    batch->Add(io_read, static_cast<double>(extended.io_read_bytes), labels);
+    batch->Add(io_write, static_cast<double>(extended.io_write_bytes), labels);
+    batch->Add(voluntary,
+               static_cast<double>(extended.voluntary_ctxt_switches), labels);
+    batch->Add(nonvoluntary,
+               static_cast<double>(extended.nonvoluntary_ctxt_switches),
+               labels);
+    batch->Add(open_fds, static_cast<double>(extended.open_fds), labels);
+    batch->Add(stats_age, proc.extended_age_seconds, labels);
+  }
+
+  const CpuProcessSummary& summary = cpu_processes.summary;
+  batch->Add(batch->AddFamily("node_processes",
+                              "Processes scanned on the node.",
+                              MetricType::kGauge),
+             static_cast<double>(summary.process_count));
+  batch->Add(batch->AddFamily("node_process_threads",
+                              "Threads across all scanned processes.",
+                              MetricType::kGauge),
+             static_cast<double>(summary.thread_count));
+  const auto by_state =
+      batch->AddFamily("node_processes_by_state",
+                       "Scanned processes by scheduler state.",
+                       MetricType::kGauge);
+  if (summary.process_count > 0) {
+    const std::pair<const char*, unsigned long long> states[] = {
+        {"R", summary.running}, {"S", summary.sleeping},
+        {"D", summary.disk_sleep}, {"Z", summary.zombie},
+        {"T", summary.stopped},    {"I", summary.idle}};
+    for (const auto& [state, count] : states) {
+      batch->Add(by_state, static_cast<double>(count), {{"state", state}});
+    }
+  }
+  AddSummary(batch,
+             batch->AddFamily(
+                 "node_process_cpu_rate_cores",
+                 "Per-process CPU usage in cores over all scanned processes.",
+                 MetricType::kSummary),
+             summary.cpu_rate_cores);
+  AddSummary(batch,
+             batch->AddFamily(
+                 "node_process_rss_bytes",
+                 "Per-process resident memory over all scanned processes.",
+                 MetricType::kSummary),
+             summary.rss_bytes);
+}
+
+void AppendGpuFamilies(const std::vector<GpuMetrics>& gpu_metrics,
+                       MetricBatch* batch) {
+  const auto utilization =
+      batch->AddFamily("gpu_utilization_percent",
+                       "GPU utilization percentage.", MetricType::kGauge);
+  const auto memory_used =
+      batch->AddFamily("gpu_memory_used_bytes", "GPU memory used in bytes.",
+                       MetricType::kGauge);
+  const auto memory_total =
+      batch->AddFamily("gpu_memory_total_bytes", "GPU memory total in bytes.",
+                       MetricType::kGauge);
+  const auto temperature =
+      batch->AddFamily("gpu_temperature_celsius",
+                       "GPU temperature in Celsius.", MetricType::kGauge);
+  const auto power = batch->AddFamily(
+      "gpu_power_draw_watts", "GPU power draw in watts.", MetricType::kGauge);
+  const auto process_memory =
+      batch->AddFamily("gpu_process_memory_bytes",
+                       "GPU memory used per process.", MetricType::kGauge);
+  const auto numa_node = batch->AddFamily(
+      "gpu_numa_node", "NUMA node the GPU is attached to (-1 if unknown).",
+      MetricType::kGauge);
+
+  for (const auto& gpu : gpu_metrics) {
+    const std::string index = std::to_string(gpu.index);
+    const std::initializer_list<MetricLabel> labels = {{"gpu_index", index}};
+    batch->Add(utilization, gpu.utilization_gpu_percent, labels);
+    batch->Add(memory_used, static_cast<double>(gpu.memory_used_bytes),
+               labels);
+    batch->Add(memory_total, static_cast<double>(gpu.memory_total_bytes),
+               labels);
+    batch->Add(temperature, gpu.temperature_c, labels);
+    if (gpu.power_available) {
+      batch->Add(power, gpu.power_watts, labels);
+    }
+    if (!gpu.pci_bus_id.empty()) {
+      batch->Add(numa_node, gpu.numa_node,
+                 {{"gpu_index", index}, {"pci_bus_id", gpu.pci_bus_id}});
+    }
+    for (const auto& proc : gpu.processes) {
+      batch->Add(process_memory,
+                 static_cast<double>(proc.used_gpu_memory_bytes),
+                 {{"gpu_index", index}, {"pid", std::to_string(proc.pid)}});
+    }
+  }
+}
+
+void AppendAgentFamilies(const AgentMetrics& agent_metrics,
+                         MetricBatch* batch) {
+  const PsiTriggerStats& psi = agent_metrics.psi_triggers;
+  batch->Add(batch->AddFamily("agent_psi_triggers_active",
+                              "Whether PSI triggers are registered (1) or "
+                              "pressure is polled (0).",
+                              MetricType::kGauge),
+             psi.active ? 1 : 0);
+  const auto psi_events =
+      batch->AddFamily("agent_psi_trigger_events_total",
+                       "PSI trigger notifications received.",
+                       MetricType::kCounter);
+  batch->Add(psi_events, static_cast<double>(psi.cpu_events),
+             {{"resource", "cpu"}});
+  batch->Add(psi_events, static_cast<double>(psi.memory_events),
+             {{"resource", "memory"}});
+  batch->Add(psi_events, static_cast<double>(psi.io_events),
+             {{"resource", "io"}});
+
+  const auto stale = batch->AddFamily(
+      "agent_collector_stale_seconds",
+      "Age of the last good sample of a collector that overran its timeout "
+      "(0 when fresh).",
+      MetricType::kGauge);
+  for (const auto& collector : agent_metrics.collectors) {
+    batch->Add(stale, collector.stale_seconds,
+               {{"collector", collector.name}});
+  }
+
+  const GpuSubsystemStatus& gpu = agent_metrics.gpu_subsystem;
+  if (gpu.state != GpuSubsystemState::kDisabled) {
+    batch->Add(batch->AddFamily("agent_gpu_subsystem_ready",
+                                "Whether NVML is initialized and usable.",
+                                MetricType::kGauge),
+               gpu.state == GpuSubsystemState::kReady ? 1 : 0);
+    batch->Add(batch->AddFamily("agent_gpu_init_attempts_total",
+                                "NVML initialization attempts.",
+                                MetricType::kCounter),
+               static_cast<double>(gpu.init_attempts));
+    batch->Add(batch->AddFamily("agent_gpu_reinitializations_total",
+                                "NVML re-initializations after a lost GPU.",
+                                MetricType::kCounter),
+               static_cast<double>(gpu.reinitializations));
+  }
+}
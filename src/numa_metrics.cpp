@@ -0,0 +1,197 @@
+#include "numa_metrics.hpp"
+
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include "collectors.hpp"
+#include "util.hpp"
+
+namespace {
+
+#ifdef __linux__
+constexpr const char* kNodeRoot = "/sys/devices/system/node";
+
+struct NumaNodeFiles {
+  int node = 0;
+  std::string cpulist;
+  unsigned int cpu_count = 0;
+  std::unique_ptr<CachedFile> meminfo;
+  std::unique_ptr<CachedFile> numastat;
+};
+
+// Guards the topology cache and rate state below.
+std::mutex g_numa_mutex;
+CachedFile g_online_nodes_file(std::string(kNodeRoot) + "/online");
+// Contents of node/online the cached topology was built for.
+std::string g_online_nodes;
+std::vector<NumaNodeFiles> g_numa_nodes;
+
+struct NumaCounters {
+  unsigned long long miss = 0;
+  unsigned long long foreign = 0;
+};
+std::unordered_map<int, NumaCounters> g_prev_counters;
+std::chrono::steady_clock::time_point g_prev_scan;
+
+// Rebuilds the per-node file handles and CPU lists when nodes come or go
+// (memory hotplug); otherwise topology is read once.
+void RefreshTopologyLocked() {
+  std::string online;
+  if (!g_online_nodes_file.Read(&online) || online == g_online_nodes) {
+    return;
+  }
+  g_online_nodes = online;
+  g_numa_nodes.clear();
+  for (int node : ParseList(online)) {
+    const std::string dir =
+        std::string(kNodeRoot) + "/node" + std::to_string(node);
+    NumaNodeFiles files;
+    files.node = node;
+    files.cpulist = ReadFile(dir + "/cpulist");
+    files.cpulist.erase(files.cpulist.find_last_not_of(" \n") + 1);
+    files.cpu_count =
+        static_cast<unsigned int>(ParseList(files.cpulist).size());
+    files.meminfo = std::make_unique<CachedFile>(dir + "/meminfo");
+    files.numastat = std::make_unique<CachedFile>(dir + "/numastat");
+    g_numa_nodes.push_back(std::move(files));
+  }
+}
+#endif
+
+}  // namespace
+
+std::vector<NumaNodeMetrics> CollectNumaMetrics() {
+  std::vector<NumaNodeMetrics> result;
+
+#ifdef __linux__
+  std::lock_guard<std::mutex> lock(g_numa_mutex);
+  RefreshTopologyLocked();
+
+  const auto now = std::chrono::steady_clock::now();
+  const double elapsed =
+      std::chrono::duration<double>(now - g_prev_scan).count();
+  std::unordered_map<int, NumaCounters> counters;
+  std::string content;
+  for (const NumaNodeFiles& files : g_numa_nodes) {
+    NumaNodeMetrics metrics;
+    metrics.node = files.node;
+    metrics.cpulist = files.cpulist;
+    metrics.cpu_count = files.cpu_count;
+
+    // Lines look like "Node 0 MemFree:         3790668 kB".
+    if (files.meminfo->Read(&content)) {
+      std::istringstream stream(content);
+      std::string line;
+      while (std::getline(stream, line)) {
+        std::istringstream fields(line);
+        std::string label;
+        int node = 0;
+        std::string key;
+        unsigned long long value_kb = 0;
+        if (!(fields >> label >> node >> key >> value_kb)) {
+          continue;
+        }
+        if (key == "MemTotal:") {
+          metrics.mem_total_bytes = value_kb * 1024ULL;
+        } else if (key == "MemFree:") {
+          metrics.mem_free_bytes = value_kb * 1024ULL;
+        }
+      }
+    }
+
+    NumaCounters current;
+    if (files.numastat->Read(&content)) {
+      std::istringstream stream(content);
+      std::string key;
+      unsigned long long value = 0;
+      while (stream >> key >> value) {
+        if (key == "numa_miss") {
+          current.miss = value;
+        } else if (key == "numa_foreign") {
+          current.foreign = value;
+        }
+      }
+      counters[files.node] = current;
+
+      auto previous = g_prev_counters.find(files.node);
+      if (previous != g_prev_counters.end() && elapsed > 0.0 &&
+          current.miss >= previous->second.miss &&
+          current.foreign >= previous->second.foreign) {
+        metrics.rates_available = true;
+        metrics.numa_miss_per_second =
+            static_cast<double>(current.miss - previous->second.miss) /
+            elapsed;
+        metrics.numa_foreign_per_second =
+            static_cast<double>(current.foreign - previous->second.foreign) /
+            elapsed;
+      }
+    }
+    result.push_back(std::move(metrics));
+  }
+  g_prev_counters.swap(counters);
+  g_prev_scan = now;
+#endif
+
+  return result;
+}
+
+int GetPciDeviceNumaNode(const std::string& pci_bus_id) {
+#ifdef __linux__
+  static std::mutex cache_mutex;
+  static std::unordered_map<std::string, int> cache;
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  auto it = cache.find(pci_bus_id);
+  if (it != cache.end()) {
+    return it->second;
+  }
+  const std::string value =
+      ReadFile("/sys/bus/pci/devices/" + pci_bus_id + "/numa_node");
+  const int node = value.empty() ? -1 : std::atoi(value.c_str());
+  cache.emplace(pci_bus_id, node);
+  return node;
+#else
+  (void)pci_bus_id;
+  return -1;
+#endif
+}
+
+void SaveNumaCounterBaselines(std::vector<CounterBaseline>* baselines) {
+#ifdef __linux__
+  std::lock_guard<std::mutex> lock(g_numa_mutex);
+  for (const auto& [node, counters] : g_prev_counters) {
+    CounterBaseline record;
+    record.kind = CounterKind::kNumaEvents;
+    record.key = static_cast<uint64_t>(node);
+    record.values[0] = counters.miss;
+    record.values[1] = counters.foreign;
+    baselines->push_back(record);
+  }
+#else
+  (void)baselines;
+#endif
+}
+
+void RestoreNumaCounterBaselines(
+    const std::vector<CounterBaseline>& baselines,
+    std::chrono::system_clock::time_point saved_at) {
+#ifdef __linux__
+  std::lock_guard<std::mutex> lock(g_numa_mutex);
+  g_prev_counters.clear();
+  for (const CounterBaseline& record : baselines) {
+    if (record.kind == CounterKind::kNumaEvents) {
+      g_prev_counters[static_cast<int>(record.key)] = {record.values[0],
+                                                       record.values[1]};
+    }
+  }
+  const auto age = std::chrono::system_clock::now() - saved_at;
+  g_prev_scan = std::chrono::steady_clock::now() -
+                std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    age);
+#else
+  (void)baselines;
+  (void)saved_at;
+#endif
+}
@@ -0,0 +1,171 @@
+#include "process_sampler.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "util.hpp"
+
+namespace {
+
+// Upper bound on fd entries walked per process; larger tables report the
+// bound.
+constexpr unsigned long long kMaxCountedOpenFds = 4096;
+
+// Returns the number following `key` on its own line of a "key: value"
+// procfs file, or 0 when missing.
+unsigned long long ParseKeyedValue(const std::string& content,
+                                   const char* key) {
+  const size_t key_length = std::strlen(key);
+  size_t pos = 0;
+  while (pos < content.size()) {
+    if (content.compare(pos, key_length, key) == 0) {
+      return std::strtoull(content.c_str() + pos + key_length, nullptr, 10);
+    }
+    pos = content.find('\n', pos);
+    if (pos == std::string::npos) {
+      break;
+    }
+    ++pos;
+  }
+  return 0;
+}
+
+#ifdef __linux__
+unsigned long long CountOpenFds(const std::string& proc_path) {
+  const std::string fd_path = proc_path + "/fd";
+  // Linux 6.2+ reports the open fd count as the directory size.
+  struct stat st {};
+  if (stat(fd_path.c_str(), &st) == 0 && st.st_size > 0) {
+    return static_cast<unsigned long long>(st.st_size);
+  }
+  DIR* fd_dir = opendir(fd_path.c_str());
+  if (!fd_dir) {
+    return 0;
+  }
+  unsigned long long count = 0;
+  struct dirent* entry = nullptr;
+  while (count < kMaxCountedOpenFds &&
+         (entry = readdir(fd_dir)) != nullptr) {
+    if (entry->d_name[0] != '.') {
+      ++count;
+    }
+  }
+  closedir(fd_dir);
+  return count;
+}
+#endif
+
+}  // namespace
+
+ExtendedStatsSampler::ExtendedStatsSampler(size_t hot_count,
+                                           size_t processes_per_cycle,
+                                           std::chrono::milliseconds time_budget)
+    : hot_count_(hot_count),
+      processes_per_cycle_(processes_per_cycle),
+      time_budget_(time_budget) {}
+
+bool ExtendedStatsSampler::ReadInto(const CpuProcessMetrics& proc,
+                                    std::chrono::steady_clock::time_point now) {
+#ifdef __linux__
+  const std::string proc_path = "/proc/" + std::to_string(proc.pid);
+  std::string status = ReadFile(proc_path + "/status");
+  if (status.empty()) {
+    return false;
+  }
+
+  CachedStats& cached = cache_[proc.pid];
+  cached.start_time_ticks = proc.start_time_ticks;
+  cached.sampled_at = now;
+  cached.stats.voluntary_ctxt_switches =
+      ParseKeyedValue(status, "voluntary_ctxt_switches:");
+  cached.stats.nonvoluntary_ctxt_switches =
+      ParseKeyedValue(status, "nonvoluntary_ctxt_switches:");
+  // /proc/<pid>/io needs ptrace access; leave it at 0 when unreadable.
+  std::string io = ReadFile(proc_path + "/io");
+  cached.stats.io_read_bytes = ParseKeyedValue(io, "read_bytes:");
+  cached.stats.io_write_bytes = ParseKeyedValue(io, "write_bytes:");
+  cached.stats.open_fds = CountOpenFds(proc_path);
+  return true;
+#else
+  (void)proc;
+  (void)now;
+  return false;
+#endif
+}
+
+void ExtendedStatsSampler::Sample(std::vector<CpuProcessMetrics>* processes) {
+  const auto deadline = std::chrono::steady_clock::now() + time_budget_;
+
+  // Drop samples of processes that exited, left the exported set or whose
+  // pid was reused.
+  std::unordered_map<int, CachedStats> live;
+  live.reserve(processes->size());
+  for (const auto& proc : *processes) {
+    auto it = cache_.find(proc.pid);
+    if (it != cache_.end() &&
+        it->second.start_time_ticks == proc.start_time_ticks) {
+      live.emplace(proc.pid, std::move(it->second));
+    }
+  }
+  cache_.swap(live);
+
+  // The hot tier is the busiest processes right now rather than by lifetime
+  // CPU time, so long-lived idle daemons fall back to the round-robin.
+  std::vector<const CpuProcessMetrics*> order;
+  order.reserve(processes->size());
+  for (const auto& proc : *processes) {
+    order.push_back(&proc);
+  }
+  const size_t hot_count = std::min(hot_count_, order.size());
+  std::partial_sort(order.begin(), order.begin() + hot_count, order.end(),
+                    [](const CpuProcessMetrics* a, const CpuProcessMetrics* b) {
+                      return a->cpu_rate_cores > b->cpu_rate_cores;
+                    });
+
+  // Hot processes are read first and are charged to the same budget.
+  size_t budget = processes_per_cycle_;
+  const auto within_budget = [&budget, &deadline] {
+    return budget > 0 && std::chrono::steady_clock::now() <= deadline;
+  };
+  for (size_t i = 0; i < hot_count && within_budget(); ++i, --budget) {
+    ReadInto(*order[i], std::chrono::steady_clock::now());
+  }
+
+  // Round-robin over the rest in pid order, resuming after the cursor.
+  std::vector<const CpuProcessMetrics*> tail(order.begin() + hot_count,
+                                             order.end());
+  std::sort(tail.begin(), tail.end(),
+            [](const CpuProcessMetrics* a, const CpuProcessMetrics* b) {
+              return a->pid < b->pid;
+            });
+  const size_t first = static_cast<size_t>(
+      std::upper_bound(tail.begin(), tail.end(), tail_cursor_,
+                       [](int pid, const CpuProcessMetrics* proc) {
+                         return pid < proc->pid;
+                       }) -
+      tail.begin());
+  for (size_t n = 0; n < tail.size() && within_budget(); ++n, --budget) {
+    const CpuProcessMetrics* proc = tail[(first + n) % tail.size()];
+    ReadInto(*proc, std::chrono::steady_clock::now());
+    tail_cursor_ = proc->pid;
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  for (auto& proc : *processes) {
+    auto it = cache_.find(proc.pid);
+    if (it == cache_.end()) {
+      continue;
+    }
+    proc.extended_available = true;
+    proc.extended = it->second.stats;
+    proc.extended_age_seconds =
+        std::chrono::duration<double>(now - it->second.sampled_at).count();
+  }
+}
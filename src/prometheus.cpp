@@ -1,165 +1,149 @@
 #include "prometheus.hpp"
 
+#include <cmath>
 #include <string>
+#include <string_view>
 
 namespace {
 
 constexpr bool kIncludeHelpType = false;
 
-std::string EscapeLabelValue(const std::string& value) {
-  std::string out;
-  out.reserve(value.size());
+const char* TypeName(MetricType type) {
+  switch (type) {
+    case MetricType::kCounter:
+      return "counter";
+    case MetricType::kSummary:
+      return "summary";
+    case MetricType::kGauge:
+    default:
+      return "gauge";
+  }
+}
+
+// Families are rendered contiguously so that each one can be indexed by a
+// single byte range and served on its own.
+void BeginFamily(MetricsSnapshot* snapshot, std::string_view name,
+                 std::string_view help, MetricType type) {
+  snapshot->families.push_back({std::string(name), snapshot->text.size(), 0});
+  if (kIncludeHelpType) {
+    std::string* out = &snapshot->text;
+    out->append("# HELP ");
+    out->append(name);
+    out->push_back(' ');
+    out->append(help);
+    out->append("\n# TYPE ");
+    out->append(name);
+    out->push_back(' ');
+    out->append(TypeName(type));
+    out->push_back('\n');
+  }
+}
+
+void EndFamily(MetricsSnapshot* snapshot) {
+  MetricFamilyRange& family = snapshot->families.back();
+  family.length = snapshot->text.size() - family.offset;
+}
+
+}  // namespace
+
+void AppendEscapedLabelValue(std::string* out, std::string_view value) {
   for (char c : value) {
     switch (c) {
       case '\\':
-        out += "\\\\";
+        out->append("\\\\");
         break;
       case '"':
-        out += "\\\"";
+        out->append("\\\"");
         break;
       case '\n':
-        out += "\\n";
+        out->append("\\n");
         break;
       default:
-        out += c;
+        out->push_back(c);
         break;
     }
   }
-  return out;
 }
 
-template <typename T>
-void AppendNumber(std::string* out, T value) {
-  out->append(std::to_string(value));
+void AppendSampleValue(std::string* out, double value) {
+  if (std::isnan(value)) {
+    out->append("NaN");
+  } else if (std::isinf(value)) {
+    out->append(value > 0 ? "+Inf" : "-Inf");
+  } else if (value == std::trunc(value) && std::fabs(value) < 1e15) {
+    out->append(std::to_string(static_cast<long long>(value)));
+  } else {
+    out->append(std::to_string(value));
+  }
 }
 
-}  // namespace
-
-void FormatPrometheus(const CpuMetrics& cpu_metrics,
-                      const CpuTopProcesses& cpu_processes,
-                      const std::vector<GpuMetrics>& gpu_metrics,
-                      std::string* out) {
-  if (!out) {
+void EncodePrometheusText(const MetricBatch& batch, MetricsSnapshot* snapshot) {
+  if (!snapshot) {
     return;
   }
-  out->clear();
-  if (kIncludeHelpType) {
-    out->append("# HELP cpu_load_1m 1-minute system load average.\n");
-    out->append("# TYPE cpu_load_1m gauge\n");
-    out->append("# HELP node_cpu_utilization_ratio CPU utilization ratio (0-1).\n");
-    out->append("# TYPE node_cpu_utilization_ratio gauge\n");
-    out->append(
-        "# HELP node_cpu_pressure_avg10 CPU pressure avg10 (0-100).\n");
-    out->append("# TYPE node_cpu_pressure_avg10 gauge\n");
-    out->append(
-        "# HELP node_memory_pressure_avg10 Memory pressure avg10 (0-100).\n");
-    out->append("# TYPE node_memory_pressure_avg10 gauge\n");
-    out->append("# HELP node_memory_total_bytes System memory total in bytes.\n");
-    out->append("# TYPE node_memory_total_bytes gauge\n");
-    out->append(
-        "# HELP node_memory_available_bytes System memory available in bytes.\n");
-    out->append("# TYPE node_memory_available_bytes gauge\n");
-    out->append("# HELP node_health_score Overall node health score (0-10).\n");
-    out->append("# TYPE node_health_score gauge\n");
-    out->append("# HELP cpu_process_cpu_seconds_total Process CPU time in seconds.\n");
-    out->append("# TYPE cpu_process_cpu_seconds_total counter\n");
-    out->append("# HELP cpu_process_rss_bytes Process resident memory in bytes.\n");
-    out->append("# TYPE cpu_process_rss_bytes gauge\n");
-    out->append("# HELP gpu_utilization_percent GPU utilization percentage.\n");
-    out->append("# TYPE gpu_utilization_percent gauge\n");
-    out->append("# HELP gpu_memory_used_bytes GPU memory used in bytes.\n");
-    out->append("# TYPE gpu_memory_used_bytes gauge\n");
-    out->append("# HELP gpu_memory_total_bytes GPU memory total in bytes.\n");
-    out->append("# TYPE gpu_memory_total_bytes gauge\n");
-    out->append("# HELP gpu_temperature_celsius GPU temperature in Celsius.\n");
-    out->append("# TYPE gpu_temperature_celsius gauge\n");
-    out->append("# HELP gpu_power_draw_watts GPU power draw in watts.\n");
-    out->append("# TYPE gpu_power_draw_watts gauge\n");
-    out->append("# HELP gpu_process_memory_bytes GPU memory used per process.\n");
-    out->append("# TYPE gpu_process_memory_bytes gauge\n");
+  snapshot->text.clear();
+  snapshot->families.clear();
+  std::string* out = &snapshot->text;
+
+  // Samples may be appended in any family order; bucket them by family
+  // (counting sort, stable within a family) so each renders contiguously.
+  const size_t family_count = batch.family_count();
+  std::vector<size_t> family_begin(family_count + 1, 0);
+  for (size_t sample = 0; sample < batch.sample_count(); ++sample) {
+    ++family_begin[batch.sample_family(sample) + 1];
   }
-
-  out->append("cpu_load_1m ");
-  AppendNumber(out, cpu_metrics.load_1m);
-  out->push_back('\n');
-  out->append("node_cpu_utilization_ratio ");
-  AppendNumber(out, cpu_metrics.cpu_utilization);
-  out->push_back('\n');
-  out->append("node_cpu_pressure_avg10 ");
-  AppendNumber(out, cpu_metrics.cpu_pressure_avg10);
-  out->push_back('\n');
-  out->append("node_memory_pressure_avg10 ");
-  AppendNumber(out, cpu_metrics.memory_pressure_avg10);
-  out->push_back('\n');
-  out->append("node_memory_total_bytes ");
-  AppendNumber(out, cpu_metrics.mem_total_bytes);
-  out->push_back('\n');
-  out->append("node_memory_available_bytes ");
-  AppendNumber(out, cpu_metrics.mem_available_bytes);
-  out->push_back('\n');
-  out->append("node_health_score ");
-  AppendNumber(out, ComputeNodeHealthScore(cpu_metrics));
-  out->push_back('\n');
-
-  for (const auto& proc : cpu_processes.processes) {
-    out->append("cpu_process_cpu_seconds_total{pid=\"");
-    AppendNumber(out, proc.pid);
-    out->append("\",name=\"");
-    out->append(EscapeLabelValue(proc.name));
-    out->append("\"} ");
-    AppendNumber(out, proc.cpu_time_seconds);
-    out->push_back('\n');
-
-    out->append("cpu_process_rss_bytes{pid=\"");
-    AppendNumber(out, proc.pid);
-    out->append("\",name=\"");
-    out->append(EscapeLabelValue(proc.name));
-    out->append("\"} ");
-    AppendNumber(out, proc.rss_bytes);
-    out->push_back('\n');
+  for (size_t family = 0; family < family_count; ++family) {
+    family_begin[family + 1] += family_begin[family];
+  }
+  std::vector<size_t> order(batch.sample_count());
+  std::vector<size_t> next(family_begin.begin(), family_begin.end() - 1);
+  for (size_t sample = 0; sample < batch.sample_count(); ++sample) {
+    order[next[batch.sample_family(sample)]++] = sample;
   }
 
-  for (const auto& gpu : gpu_metrics) {
-    out->append("gpu_utilization_percent{gpu_index=\"");
-    AppendNumber(out, gpu.index);
-    out->append("\"} ");
-    AppendNumber(out, gpu.utilization_gpu_percent);
-    out->push_back('\n');
-
-    out->append("gpu_memory_used_bytes{gpu_index=\"");
-    AppendNumber(out, gpu.index);
-    out->append("\"} ");
-    AppendNumber(out, gpu.memory_used_bytes);
-    out->push_back('\n');
-
-    out->append("gpu_memory_total_bytes{gpu_index=\"");
-    AppendNumber(out, gpu.index);
-    out->append("\"} ");
-    AppendNumber(out, gpu.memory_total_bytes);
-    out->push_back('\n');
-
-    out->append("gpu_temperature_celsius{gpu_index=\"");
-    AppendNumber(out, gpu.index);
-    out->append("\"} ");
-    AppendNumber(out, gpu.temperature_c);
-    out->push_back('\n');
-
-    if (gpu.power_available) {
-      out->append("gpu_power_draw_watts{gpu_index=\"");
-      AppendNumber(out, gpu.index);
-      out->append("\"} ");
-      AppendNumber(out, gpu.power_watts);
+  for (MetricBatch::FamilyId id = 0; id < family_count; ++id) {
+    if (family_begin[id] == family_begin[id + 1]) {
+      continue;
+    }
+    const MetricBatch::Family& family = batch.family(id);
+    const std::string_view name = batch.string(family.name);
+    BeginFamily(snapshot, name, batch.string(family.help), family.type);
+    for (size_t i = family_begin[id]; i < family_begin[id + 1]; ++i) {
+      const size_t sample = order[i];
+      out->append(name);
+      out->append(batch.string(batch.sample_suffix(sample)));
+      const size_t label_begin = batch.sample_label_begin(sample);
+      const size_t label_end = batch.sample_label_begin(sample + 1);
+      for (size_t label = label_begin; label < label_end; ++label) {
+        out->push_back(label == label_begin ? '{' : ',');
+        out->append(batch.string(batch.label_name(label)));
+        out->append("=\"");
+        AppendEscapedLabelValue(out, batch.string(batch.label_value(label)));
+        out->push_back('"');
+      }
+      out->append(label_begin == label_end ? " " : "} ");
+      AppendSampleValue(out, batch.sample_value(sample));
       out->push_back('\n');
     }
+    EndFamily(snapshot);
+  }
+}
 
-    for (const auto& proc : gpu.processes) {
-      out->append("gpu_process_memory_bytes{gpu_index=\"");
-      AppendNumber(out, gpu.index);
-      out->append("\",pid=\"");
-      AppendNumber(out, proc.pid);
-      out->append("\"} ");
-      AppendNumber(out, proc.used_gpu_memory_bytes);
-      out->push_back('\n');
+std::vector<MetricFamilyRange> SelectMetricFamilies(
+    const MetricsSnapshot& snapshot, const std::vector<std::string>& names) {
+  std::vector<MetricFamilyRange> selected;
+  for (const auto& family : snapshot.families) {
+    for (const auto& name : names) {
+      const bool is_prefix = !name.empty() && name.back() == '*';
+      const bool matches =
+          is_prefix ? family.name.compare(0, name.size() - 1, name, 0,
+                                          name.size() - 1) == 0
+                    : family.name == name;
+      if (matches) {
+        selected.push_back(family);
+        break;
+      }
     }
   }
+  return selected;
 }
@@ -0,0 +1,201 @@
+#include "psi_triggers.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+std::atomic<bool> g_active{false};
+std::atomic<unsigned long long> g_cpu_events{0};
+std::atomic<unsigned long long> g_memory_events{0};
+std::atomic<unsigned long long> g_io_events{0};
+std::thread g_watcher;
+
+#ifdef __linux__
+// Fire when tasks are stalled for 150ms within any 1s window.
+constexpr const char* kPsiTrigger = "some 150000 1000000";
+// Without CAP_SYS_RESOURCE the kernel only accepts windows that are a
+// multiple of 2s, so unprivileged agents fall back to this.
+constexpr const char* kUnprivilegedPsiTrigger = "some 150000 2000000";
+
+// Written by StopPsiTriggerWatcher() to wake the watcher out of poll().
+int g_stop_pipe[2] = {-1, -1};
+
+struct PsiTrigger {
+  const char* path;
+  std::atomic<unsigned long long>* events;
+  int fd = -1;
+};
+
+bool WriteTrigger(int fd, const char* trigger) {
+  // The kernel expects the trailing NUL to be part of the write.
+  return write(fd, trigger, std::strlen(trigger) + 1) >= 0;
+}
+
+int RegisterPsiTrigger(const char* path) {
+  int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "PSI: failed to open " << path << ": " << std::strerror(errno)
+              << std::endl;
+    return -1;
+  }
+  if (!WriteTrigger(fd, kPsiTrigger) &&
+      !(errno == EINVAL && WriteTrigger(fd, kUnprivilegedPsiTrigger))) {
+    std::cerr << "PSI: failed to register trigger on " << path << ": "
+              << std::strerror(errno) << std::endl;
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+void WatchPsiTriggers(std::vector<PsiTrigger> triggers,
+                      std::function<void()> on_trigger, int stop_fd) {
+  std::vector<pollfd> fds;
+  fds.reserve(triggers.size() + 1);
+  for (const auto& trigger : triggers) {
+    fds.push_back(pollfd{trigger.fd, POLLPRI, 0});
+  }
+  fds.push_back(pollfd{stop_fd, POLLIN, 0});
+
+  bool stopped = false;
+  while (true) {
+    int ready = poll(fds.data(), fds.size(), -1);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "PSI: poll failed: " << std::strerror(errno) << std::endl;
+      break;
+    }
+    if (fds.back().revents != 0) {
+      stopped = true;
+      break;
+    }
+
+    bool fired = false;
+    size_t remaining = 0;
+    for (size_t i = 0; i < triggers.size(); ++i) {
+      if (fds[i].fd < 0) {
+        continue;
+      }
+      if (fds[i].revents & POLLERR) {
+        // The monitored resource went away; stop watching it.
+        std::cerr << "PSI: trigger on " << triggers[i].path << " invalidated"
+                  << std::endl;
+        close(fds[i].fd);
+        fds[i].fd = -1;
+        continue;
+      }
+      if (fds[i].revents & POLLPRI) {
+        triggers[i].events->fetch_add(1, std::memory_order_relaxed);
+        fired = true;
+      }
+      ++remaining;
+    }
+
+    if (fired) {
+      on_trigger();
+    }
+    if (remaining == 0) {
+      break;
+    }
+  }
+
+  for (size_t i = 0; i < triggers.size(); ++i) {
+    if (fds[i].fd >= 0) {
+      close(fds[i].fd);
+    }
+  }
+  g_active.store(false);
+  if (!stopped) {
+    std::cerr << "PSI: trigger watcher stopped; falling back to polling"
+              << std::endl;
+  }
+}
+#endif
+
+}  // namespace
+
+bool StartPsiTriggerWatcher(std::function<void()> on_trigger) {
+#ifdef __linux__
+  std::vector<PsiTrigger> triggers = {
+      {"/proc/pressure/cpu", &g_cpu_events},
+      {"/proc/pressure/memory", &g_memory_events},
+      {"/proc/pressure/io", &g_io_events},
+  };
+
+  std::vector<PsiTrigger> registered;
+  for (auto& trigger : triggers) {
+    trigger.fd = RegisterPsiTrigger(trigger.path);
+    if (trigger.fd >= 0) {
+      registered.push_back(trigger);
+    }
+  }
+  if (registered.empty()) {
+    std::cerr << "PSI: no triggers registered; pressure refreshed by polling"
+              << std::endl;
+    return false;
+  }
+
+  if (g_watcher.joinable() || pipe(g_stop_pipe) != 0) {
+    for (const auto& trigger : registered) {
+      close(trigger.fd);
+    }
+    return false;
+  }
+  fcntl(g_stop_pipe[0], F_SETFD, FD_CLOEXEC);
+  fcntl(g_stop_pipe[1], F_SETFD, FD_CLOEXEC);
+
+  std::cout << "PSI triggers registered on " << registered.size()
+            << " resources" << std::endl;
+  g_active.store(true);
+  g_watcher = std::thread(WatchPsiTriggers, std::move(registered),
+                          std::move(on_trigger), g_stop_pipe[0]);
+  return true;
+#else
+  (void)on_trigger;
+  std::cout << "PSI triggers unavailable on this platform" << std::endl;
+  return false;
+#endif
+}
+
+void StopPsiTriggerWatcher() {
+#ifdef __linux__
+  if (!g_watcher.joinable()) {
+    return;
+  }
+  const char wake = 1;
+  if (write(g_stop_pipe[1], &wake, 1) < 0) {
+    std::cerr << "PSI: failed to stop watcher: " << std::strerror(errno)
+              << std::endl;
+    g_watcher.detach();
+  } else {
+    g_watcher.join();
+  }
+  close(g_stop_pipe[0]);
+  close(g_stop_pipe[1]);
+  g_stop_pipe[0] = g_stop_pipe[1] = -1;
+#endif
+}
+
+PsiTriggerStats GetPsiTriggerStats() {
+  PsiTriggerStats stats;
+  stats.active = g_active.load();
+  stats.cpu_events = g_cpu_events.load(std::memory_order_relaxed);
+  stats.memory_events = g_memory_events.load(std::memory_order_relaxed);
+  stats.io_events = g_io_events.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,146 @@
+#include "shm_export.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+ShmSnapshotWriter::~ShmSnapshotWriter() { Close(); }
+
+void ShmSnapshotWriter::Close() {
+  if (file_) {
+    munmap(file_, sizeof(ShmSnapshotFile));
+    file_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool ShmSnapshotWriter::Open(const std::string& path) {
+  Close();
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    std::cerr << "Shared-memory export: failed to open " << path << ": "
+              << std::strerror(errno) << std::endl;
+    return false;
+  }
+  // The lock lives as long as `fd_`; a second writer would corrupt the
+  // generations of the first.
+  if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+    std::cerr << "Shared-memory export: " << path
+              << (errno == EWOULDBLOCK
+                      ? " is already written by another agent"
+                      : std::string(" could not be locked: ") +
+                            std::strerror(errno))
+              << "; export disabled (use --shm-path to pick another file)"
+              << std::endl;
+    close(fd);
+    return false;
+  }
+  if (ftruncate(fd, sizeof(ShmSnapshotFile)) != 0) {
+    std::cerr << "Shared-memory export: failed to size " << path << ": "
+              << std::strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, sizeof(ShmSnapshotFile), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  if (mapped == MAP_FAILED) {
+    std::cerr << "Shared-memory export: failed to map " << path << ": "
+              << std::strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+
+  fd_ = fd;
+  file_ = static_cast<ShmSnapshotFile*>(mapped);
+  ShmSnapshotHeader& header = file_->header;
+  if (header.magic != kShmSnapshotMagic ||
+      header.version != kShmSnapshotVersion ||
+      header.data_size != sizeof(ShmSnapshotData)) {
+    // Invalidate the header first so that readers still mapping the old
+    // layout stop decoding it (see ShmSnapshotReader::ReadConsistent).
+    header.magic = 0;
+    std::atomic_thread_fence(std::memory_order_release);
+    header.version = kShmSnapshotVersion;
+    header.data_size = sizeof(ShmSnapshotData);
+    header.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header.magic = kShmSnapshotMagic;
+  } else if (header.sequence.load(std::memory_order_relaxed) & 1) {
+    // A previous writer died mid-publish; make the sequence even again.
+    header.sequence.fetch_add(1, std::memory_order_release);
+  }
+  std::cout << "Shared-memory snapshot at " << path << std::endl;
+  return true;
+}
+
+void ShmSnapshotWriter::Publish(const CpuMetrics& cpu_metrics,
+                                const HealthScore& health,
+                                const CpuTopProcesses& cpu_processes,
+                                const std::vector<GpuMetrics>& gpu_metrics) {
+  if (!file_) {
+    return;
+  }
+
+  // Build the snapshot off to the side so the seqlock write window is a
+  // single memcpy.
+  ShmSnapshotData& data = staging_;
+  std::memset(&data, 0, sizeof(data));
+  data.timestamp_unix_nanos =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  data.node.load_1m = cpu_metrics.load_1m;
+  data.node.cpu_utilization = cpu_metrics.cpu_utilization;
+  data.node.cpu_pressure_avg10 = cpu_metrics.cpu_pressure_avg10;
+  data.node.memory_pressure_avg10 = cpu_metrics.memory_pressure_avg10;
+  data.node.io_pressure_avg10 = cpu_metrics.io_pressure_avg10;
+  data.node.health_score = health.raw;
+  data.node.mem_total_bytes = cpu_metrics.mem_total_bytes;
+  data.node.mem_available_bytes = cpu_metrics.mem_available_bytes;
+  data.node.health_score_smoothed = health.smoothed;
+  data.node.cpu_capacity_cores = health.cpu_capacity_cores;
+
+  data.gpu_count =
+      static_cast<uint32_t>(std::min(gpu_metrics.size(), kShmMaxGpus));
+  for (uint32_t i = 0; i < data.gpu_count; ++i) {
+    const GpuMetrics& gpu = gpu_metrics[i];
+    ShmGpuMetrics& out = data.gpus[i];
+    out.index = gpu.index;
+    out.utilization_percent = gpu.utilization_gpu_percent;
+    out.temperature_c = gpu.temperature_c;
+    out.power_available = gpu.power_available ? 1 : 0;
+    out.power_watts = gpu.power_watts;
+    out.memory_used_bytes = gpu.memory_used_bytes;
+    out.memory_total_bytes = gpu.memory_total_bytes;
+  }
+
+  data.process_count = static_cast<uint32_t>(
+      std::min(cpu_processes.processes.size(), kShmMaxProcesses));
+  for (uint32_t i = 0; i < data.process_count; ++i) {
+    const CpuProcessMetrics& proc = cpu_processes.processes[i];
+    ShmProcessMetrics& out = data.processes[i];
+    out.pid = proc.pid;
+    out.cpu_time_seconds = proc.cpu_time_seconds;
+    out.rss_bytes = proc.rss_bytes;
+    std::strncpy(out.name, proc.name.c_str(), kShmProcessNameSize - 1);
+  }
+
+  std::atomic<uint64_t>& sequence = file_->header.sequence;
+  const uint64_t current = sequence.load(std::memory_order_relaxed);
+  sequence.store(current + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(static_cast<void*>(&file_->data), &data, sizeof(data));
+  sequence.store(current + 2, std::memory_order_release);
+}
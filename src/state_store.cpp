@@ -0,0 +1,166 @@
+#include "state_store.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#include <sys/time.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "util.hpp"
+
+namespace {
+
+constexpr uint64_t kStateMagic = 0x4154535441464e4eULL;  // "NNFATSTA"
+constexpr uint32_t kStateVersion = 1;
+constexpr size_t kBootIdSize = 48;
+constexpr size_t kMaxBaselines = 32768;
+// Older checkpoints are ignored; rates across such a gap are not useful.
+constexpr std::chrono::minutes kMaxStateAge{15};
+
+std::string ReadBootId() {
+#ifdef __linux__
+  std::string boot_id = ReadFile("/proc/sys/kernel/random/boot_id");
+  boot_id.erase(boot_id.find_last_not_of(" \n") + 1);
+  return boot_id;
+#elif defined(__APPLE__)
+  timeval boot_time{};
+  size_t size = sizeof(boot_time);
+  if (sysctlbyname("kern.boottime", &boot_time, &size, nullptr, 0) != 0) {
+    return "";
+  }
+  return std::to_string(boot_time.tv_sec) + "." +
+         std::to_string(boot_time.tv_usec);
+#else
+  return "";
+#endif
+}
+
+int64_t ToUnixNanos(std::chrono::system_clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+}  // namespace
+
+struct CounterStateStore::FileLayout {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  // Odd while a checkpoint is being written, so a torn file is rejected.
+  uint64_t sequence;
+  char boot_id[kBootIdSize];
+  int64_t saved_at_unix_nanos;
+  uint32_t record_count;
+  uint32_t capacity;
+  CounterBaseline records[kMaxBaselines];
+};
+
+CounterStateStore::~CounterStateStore() {
+  if (file_) {
+    munmap(file_, mapped_size_);
+  }
+}
+
+bool CounterStateStore::Open(const std::string& path) {
+  if (file_) {
+    munmap(file_, mapped_size_);
+    file_ = nullptr;
+  }
+  restored_.clear();
+  boot_id_ = ReadBootId();
+
+  // Best effort: create the parent directory if it is missing.
+  const size_t slash = path.find_last_of('/');
+  if (slash != std::string::npos && slash > 0) {
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    std::cerr << "State store: failed to open " << path << ": "
+              << std::strerror(errno) << std::endl;
+    return false;
+  }
+  struct stat st {};
+  const bool existed =
+      fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == sizeof(FileLayout);
+  if (!existed && ftruncate(fd, sizeof(FileLayout)) != 0) {
+    std::cerr << "State store: failed to size " << path << ": "
+              << std::strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(nullptr, sizeof(FileLayout), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    std::cerr << "State store: failed to map " << path << ": "
+              << std::strerror(errno) << std::endl;
+    return false;
+  }
+  file_ = static_cast<FileLayout*>(mapped);
+  mapped_size_ = sizeof(FileLayout);
+
+  const auto now = std::chrono::system_clock::now();
+  const auto saved_at = std::chrono::system_clock::time_point(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+          std::chrono::nanoseconds(file_->saved_at_unix_nanos)));
+  const char* reject_reason = nullptr;
+  if (!existed || file_->magic != kStateMagic) {
+    reject_reason = "no previous state";
+  } else if (file_->version != kStateVersion ||
+             file_->record_size != sizeof(CounterBaseline)) {
+    reject_reason = "incompatible layout";
+  } else if (file_->sequence % 2 != 0) {
+    reject_reason = "interrupted checkpoint";
+  } else if (boot_id_.empty() ||
+             boot_id_.compare(0, kBootIdSize - 1, file_->boot_id) != 0) {
+    reject_reason = "written during a previous boot";
+  } else if (saved_at > now || now - saved_at > kMaxStateAge) {
+    reject_reason = "too old";
+  }
+
+  if (reject_reason) {
+    std::cout << "State store: not restoring baselines (" << reject_reason
+              << ")" << std::endl;
+    return true;
+  }
+  const size_t count = std::min<size_t>(file_->record_count, kMaxBaselines);
+  restored_.assign(file_->records, file_->records + count);
+  restored_at_ = saved_at;
+  std::cout << "State store: restored " << count << " baselines" << std::endl;
+  return true;
+}
+
+void CounterStateStore::Checkpoint(
+    const std::vector<CounterBaseline>& baselines) {
+  if (!file_) {
+    return;
+  }
+  const size_t count = std::min(baselines.size(), kMaxBaselines);
+  const uint64_t sequence = file_->sequence;
+  file_->sequence = sequence | 1;
+  file_->magic = kStateMagic;
+  file_->version = kStateVersion;
+  file_->record_size = sizeof(CounterBaseline);
+  std::memset(file_->boot_id, 0, kBootIdSize);
+  std::strncpy(file_->boot_id, boot_id_.c_str(), kBootIdSize - 1);
+  file_->saved_at_unix_nanos = ToUnixNanos(std::chrono::system_clock::now());
+  file_->capacity = static_cast<uint32_t>(kMaxBaselines);
+  file_->record_count = static_cast<uint32_t>(count);
+  std::copy(baselines.begin(), baselines.begin() + count, file_->records);
+  file_->sequence = (sequence | 1) + 1;
+  // Dirty pages reach the file even if the agent is killed; flushing is
+  // only scheduled so a checkpoint never blocks on disk.
+  msync(file_, mapped_size_, MS_ASYNC);
+}
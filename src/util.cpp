@@ -1,8 +1,14 @@
 #include "util.hpp"
 
+#include <cstdlib>
 #include <fstream>
 #include <sstream>
 
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 std::string ReadFile(const std::string& path) {
   std::ifstream file(path);
   if (!file.is_open()) {
@@ -12,3 +18,61 @@ std::string ReadFile(const std::string& path) {
   buffer << file.rdbuf();
   return buffer.str();
 }
+
+std::vector<int> ParseList(const std::string& list) {
+  std::vector<int> values;
+  std::istringstream stream(list);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    const size_t dash = range.find('-');
+    const int first = std::atoi(range.c_str());
+    const int last =
+        dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+    for (int value = first; value <= last; ++value) {
+      values.push_back(value);
+    }
+  }
+  return values;
+}
+
+#ifdef __linux__
+CachedFile::CachedFile(const std::string& path)
+    : path_(path), fd_(open(path.c_str(), O_RDONLY | O_CLOEXEC)) {}
+
+bool CachedFile::Reopen() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+  fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+  return fd_ >= 0;
+}
+
+CachedFile::~CachedFile() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool CachedFile::Read(std::string* out) const {
+  out->clear();
+  if (fd_ < 0) {
+    return false;
+  }
+  char buffer[4096];
+  off_t offset = 0;
+  while (true) {
+    const ssize_t bytes = pread(fd_, buffer, sizeof(buffer), offset);
+    if (bytes < 0) {
+      return false;
+    }
+    if (bytes == 0) {
+      return true;
+    }
+    out->append(buffer, static_cast<size_t>(bytes));
+    offset += bytes;
+  }
+}
+#endif